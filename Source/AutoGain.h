@@ -0,0 +1,118 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** Matches the RMS of the processed signal to the RMS of the input.
+
+    Both levels are followed by a one-pole envelope on the mean square that is
+    updated once per block, so the only transcendental calls are one exp per
+    block and one sqrt per channel per block.
+*/
+class AutoGain
+{
+public:
+    void prepare (int channels, double newSampleRate)
+    {
+        numChannels = jmax (1, channels);
+        sampleRate = newSampleRate;
+        inputLevels.calloc ((size_t)numChannels);
+        outputLevels.calloc ((size_t)numChannels);
+        gains.malloc ((size_t)numChannels);
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        inputLevels.clear ((size_t)numChannels);
+        outputLevels.clear ((size_t)numChannels);
+        for (int channel = 0; channel < numChannels; ++channel)
+            gains[channel] = 1.0f;
+    }
+
+    //==============================================================================
+
+    void beginBlock (int numSamples) noexcept
+    {
+        coefficient = 1.0f - (float)exp (-(double)numSamples / (timeConstant * sampleRate));
+    }
+
+    void measureInput (int channel, const float* data, int numSamples) noexcept
+    {
+        inputLevels[channel] += coefficient * (getMeanSquare (data, numSamples) - inputLevels[channel]);
+    }
+
+    /** Measures the processed block and applies the makeup gain, ramped from the previous one. */
+    void process (int channel, float* data, int numSamples) noexcept
+    {
+        outputLevels[channel] += coefficient * (getMeanSquare (data, numSamples) - outputLevels[channel]);
+
+        const float silence = 1e-8f;  // -80 dB
+        float target = gains[channel];
+        if (outputLevels[channel] > silence && inputLevels[channel] > silence)
+            target = jlimit (minGain, maxGain, std::sqrt (inputLevels[channel] / outputLevels[channel]));
+
+        const float start = gains[channel];
+        const float increment = (target - start) / (float)numSamples;
+        for (int i = 0; i < numSamples; ++i)
+            data[i] *= start + increment * (float)i;
+
+        gains[channel] = target;
+    }
+
+    //==============================================================================
+
+    /** Four independent accumulators, so the sum vectorises without fast-math. */
+    static float getMeanSquare (const float* data, int numSamples) noexcept
+    {
+        float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        int i = 0;
+
+        for (; i + 4 <= numSamples; i += 4)
+            for (int lane = 0; lane < 4; ++lane)
+                sum[lane] += data[i + lane] * data[i + lane];
+
+        for (; i < numSamples; ++i)
+            sum[0] += data[i] * data[i];
+
+        return numSamples > 0 ? (sum[0] + sum[1] + sum[2] + sum[3]) / (float)numSamples : 0.0f;
+    }
+
+private:
+    //==============================================================================
+
+    const double timeConstant = 0.3;  // seconds
+    const float minGain = 0.0625f;    // -24 dB
+    const float maxGain = 16.0f;      // +24 dB
+
+    int numChannels = 1;
+    double sampleRate = 44100.0;
+    float coefficient = 0.0f;
+
+    HeapBlock<float> inputLevels;
+    HeapBlock<float> outputLevels;
+    HeapBlock<float> gains;
+};
+
+//==============================================================================
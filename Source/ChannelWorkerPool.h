@@ -0,0 +1,214 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** A few pre-spawned threads that help the audio thread through independent
+    tasks inside one block.
+
+    run() publishes the tasks and then claims them itself like any worker, so it
+    never waits for a worker to start: if the workers are parked or slow the
+    audio thread simply does everything inline. It only waits for tasks that a
+    worker has already claimed, spinning for a short while and then sleeping on
+    an event the worker that finishes the last task signals. Tasks are claimed one at a time from a single
+    atomic cursor, so whoever is free takes the next one.
+
+    Idle workers spin for a short while and then park on their own event, the
+    audio thread only signals when someone is parked.
+
+    start() and stop() must not overlap with run().
+*/
+class ChannelWorkerPool
+{
+public:
+    /** worker is 0..getNumWorkers(), the caller of run() is the last one. */
+    typedef void (*Task) (void* context, int task, int worker);
+
+    enum {
+        maxTasks = 0xffff,
+    };
+
+    ChannelWorkerPool() = default;
+
+    ~ChannelWorkerPool()
+    {
+        stop();
+    }
+
+    //==============================================================================
+
+    void start (int numWorkers, int priority = 9)
+    {
+        stop();
+
+        for (int i = 0; i < numWorkers; ++i)
+            workers.add (new Worker (*this, i))->startThread (priority);
+    }
+
+    void stop()
+    {
+        for (Worker* worker : workers)
+            worker->signalThreadShouldExit();
+        for (Worker* worker : workers)
+            worker->wakeEvent.signal();
+
+        workers.clear();
+    }
+
+    int getNumWorkers() const noexcept { return workers.size(); }
+
+    //==============================================================================
+
+    /** Runs task (context, 0..numTasks - 1, worker) across the pool and returns
+        when all of them are done.
+    */
+    void run (int numTasks, Task task, void* context) noexcept
+    {
+        jassert (numTasks <= maxTasks);
+
+        currentTask = task;
+        currentContext = context;
+        completed.store (0);
+        cursor.store (pack (++generation, numTasks, 0));
+
+        if (parked.load() > 0)
+            for (Worker* worker : workers)
+                worker->wakeEvent.signal();
+
+        const int self = workers.size();
+        while (runOne (self)) {}
+
+        //everything left is on a worker; a preempted one must not keep us spinning
+        int spin = 0;
+        while (completed.load() < numTasks && ++spin < joinSpinIterations) {}
+
+        if (completed.load() < numTasks) {
+            joining.store (true);
+            while (completed.load() < numTasks)
+                doneEvent.wait (1);
+            joining.store (false);
+        }
+    }
+
+private:
+    //==============================================================================
+
+    class Worker : public Thread
+    {
+    public:
+        Worker (ChannelWorkerPool& owner, int index)
+            : Thread ("Channel worker " + String (index)), pool (owner), workerIndex (index)
+        {
+        }
+
+        ~Worker() override
+        {
+            stopThread (1000);
+        }
+
+        void run() override
+        {
+            //the flags are per thread, the one in processBlock does not reach here
+            ScopedNoDenormals noDenormals;
+
+            while (! threadShouldExit()) {
+                if (pool.runOne (workerIndex))
+                    continue;
+
+                int spin = 0;
+                while (! pool.hasWork() && ++spin < spinIterations) {}
+                if (spin < spinIterations)
+                    continue;
+
+                //announce the park before the last check, so run() either sees us parked or we see its work
+                ++pool.parked;
+                if (! pool.hasWork() && ! threadShouldExit())
+                    wakeEvent.wait (100);
+                --pool.parked;
+            }
+        }
+
+        WaitableEvent wakeEvent;
+
+    private:
+        const int spinIterations = 4000;
+        ChannelWorkerPool& pool;
+        const int workerIndex;
+    };
+
+    //==============================================================================
+
+    //the cursor holds generation, task count and next task in one word, so a
+    //late worker can never claim a task of a newer run with an older count
+    static uint64 pack (uint32 generation, int numTasks, int next) noexcept
+    {
+        return ((uint64)generation << 32) | ((uint64)numTasks << 16) | (uint64)next;
+    }
+
+    static int getNumTasks (uint64 value) noexcept { return (int)((value >> 16) & 0xffff); }
+    static int getNext (uint64 value) noexcept { return (int)(value & 0xffff); }
+
+    bool hasWork() const noexcept
+    {
+        const uint64 value = cursor.load();
+        return getNext (value) < getNumTasks (value);
+    }
+
+    bool runOne (int worker) noexcept
+    {
+        uint64 value = cursor.load();
+
+        for (;;) {
+            if (getNext (value) >= getNumTasks (value))
+                return false;
+            if (cursor.compare_exchange_weak (value, value + 1))
+                break;
+        }
+
+        //the run cannot finish before this task does, so its task and context are still current
+        currentTask (currentContext, getNext (value), worker);
+        if (++completed == getNumTasks (value) && joining.load())
+            doneEvent.signal();
+        return true;
+    }
+
+    //==============================================================================
+
+    OwnedArray<Worker> workers;
+
+    std::atomic<uint64> cursor { 0 };
+    std::atomic<int> completed { 0 };
+    std::atomic<int> parked { 0 };
+    std::atomic<bool> joining { false };  // run() sleeps on doneEvent
+    WaitableEvent doneEvent;
+    const int joinSpinIterations = 2000;
+    uint32 generation = 0;
+
+    Task currentTask = nullptr;
+    void* currentContext = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE (ChannelWorkerPool)
+};
+
+//==============================================================================
@@ -0,0 +1,102 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** Multichannel ring buffer with a power-of-two length, so wrapping is a mask.
+    All memory is allocated in prepare().
+*/
+class DelayLine
+{
+public:
+    void prepare (int channels, int maxDelaySamples)
+    {
+        const int size = nextPowerOfTwo (jmax (2, maxDelaySamples + 1));
+        buffer.setSize (jmax (1, channels), size);
+        buffer.clear();
+        mask = size - 1;
+        writePosition = 0;
+        delay = jmin (delay, mask);
+    }
+
+    void reset() noexcept
+    {
+        buffer.clear();
+        writePosition = 0;
+    }
+
+    void setDelay (int newDelay) noexcept
+    {
+        jassert (newDelay <= mask);
+        delay = jlimit (0, mask, newDelay);
+    }
+
+    int getDelay() const noexcept { return delay; }
+    int getMaxDelay() const noexcept { return mask; }
+
+    //==============================================================================
+
+    /** Pushes numSamples into the channel and replaces them with the delayed ones.
+        Call advance() once all channels of the block have been processed.
+    */
+    void process (int channel, float* data, int numSamples) noexcept
+    {
+        float* line = buffer.getWritePointer (channel);
+        int position = writePosition;
+
+        for (int i = 0; i < numSamples; ++i) {
+            line[position & mask] = data[i];
+            data[i] = line[(position - delay) & mask];
+            ++position;
+        }
+    }
+
+    /** Like process(), but leaves data untouched and writes the delayed samples to out. */
+    void process (int channel, const float* data, float* out, int numSamples) noexcept
+    {
+        float* line = buffer.getWritePointer (channel);
+        int position = writePosition;
+
+        for (int i = 0; i < numSamples; ++i) {
+            line[position & mask] = data[i];
+            out[i] = line[(position - delay) & mask];
+            ++position;
+        }
+    }
+
+    void advance (int numSamples) noexcept
+    {
+        writePosition = (writePosition + numSamples) & mask;
+    }
+
+private:
+    //==============================================================================
+
+    AudioSampleBuffer buffer;
+    int mask = 0;
+    int writePosition = 0;
+    int delay = 0;
+};
+
+//==============================================================================
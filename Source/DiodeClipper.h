@@ -0,0 +1,145 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** RC lowpass into a pair of antiparallel diodes:
+
+        C dv/dt = (vin - v) / R - 2 Is sinh (v / Vt)
+
+    Discretised with the trapezoidal rule, the whole history folds into a single
+    variable q, and every sample solves
+
+        (1 + k) v + c sinh (v / Vt) = q,    q[n] = 2 v[n-1] - q[n-1] + k (vin[n-1] + vin[n])
+
+    with k = T / 2RC and c = T Is / C. Because the solution only depends on q, the
+    fast mode is a 1-D table of v(q) rather than a table over (vin, v[n-1]).
+*/
+struct DiodeClipperModel
+{
+    enum {
+        maxIterations = 16,
+        tableSize = 4096,
+    };
+
+    float k = 0.0f;
+    float c = 0.0f;
+    float invVt = 0.0f;
+
+    const float tolerance = 1e-6f;
+    const float qLimit = 16.0f;     // table range
+    float vBound = 0.0f;            // |v| never exceeds this for any sensible input
+    float tableScale = 0.0f;
+    HeapBlock<float> table;
+
+    //==============================================================================
+
+    void prepare (double sampleRate)
+    {
+        const double R = 2.2e3;
+        const double C = 10.0e-9;
+        const double Is = 2.52e-9;
+        const double Vt = 25.85e-3;
+        const double T = 1.0 / sampleRate;
+
+        k = (float)(T / (2.0 * R * C));
+        c = (float)(T * Is / C);
+        invVt = (float)(1.0 / Vt);
+        vBound = (float)(Vt * std::asinh (1000.0 * C / (T * Is)));
+
+        table.malloc (tableSize);
+        tableScale = (float)(tableSize - 1) / (2.0f * qLimit);
+
+        float v = 0.0f;
+        int iterations = 0;
+        for (int i = 0; i < tableSize; ++i) {
+            const float q = -qLimit + (float)i / tableScale;
+            v = solve (q, v, iterations);
+            table[i] = v;
+        }
+    }
+
+    //==============================================================================
+
+    /** Newton-Raphson, warm-started from the previous solution. The residual is
+        monotonic, so every step also shrinks a bracket around the root and falls
+        back to bisection when Newton would leave it or stalls.
+    */
+    forcedinline float solve (float q, float v, int& iterations) const noexcept
+    {
+        const float bound = jmin (vBound, std::abs (q) / (1.0f + k));
+        float lo = q < 0.0f ? -bound : 0.0f;
+        float hi = q > 0.0f ? bound : 0.0f;
+        v = jlimit (lo, hi, v);
+        float step = 2.0f * vBound;  // lets the first iteration always try Newton
+        float previousStep = step;
+
+        int i = 0;
+        while (i < maxIterations) {
+            ++i;
+
+            const float e = expf (v * invVt);
+            const float eInv = 1.0f / e;
+            const float h = (1.0f + k) * v + c * 0.5f * (e - eInv) - q;
+            const float dh = 1.0f + k + c * invVt * 0.5f * (e + eInv);
+
+            if (h == 0.0f)
+                break;
+            if (h > 0.0f)
+                hi = v;
+            else
+                lo = v;
+
+            //bisect when Newton leaves the bracket or does not halve the step before last,
+            //which happens when it overshoots onto the steep side of the exponential
+            const float newton = v - h / dh;
+            previousStep = step;
+
+            if (newton < lo || newton > hi || std::abs (2.0f * h) > std::abs (previousStep * dh)) {
+                step = 0.5f * (hi - lo);
+                v = lo + step;
+            }
+            else {
+                step = h / dh;
+                v = newton;
+            }
+
+            if (std::abs (step) < tolerance)
+                break;
+        }
+
+        iterations = i;
+        return v;
+    }
+
+    forcedinline float lookup (float q) const noexcept
+    {
+        const float position = jlimit (0.0f, (float)(tableSize - 2) + 0.999f, (q + qLimit) * tableScale);
+        const int index = (int)position;
+        const float frac = position - (float)index;
+        return table[index] + frac * (table[index + 1] - table[index]);
+    }
+};
+
+//==============================================================================
@@ -0,0 +1,139 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** Requantises the wet signal to a given number of bits, with optional TPDF
+    dither and first order noise shaping.
+
+    The noise comes from a counter based generator: every value is a hash of
+    the seed, the channel and the sample index, so a whole block is one loop
+    without a dependency between samples, every channel gets its own stream,
+    and the same seed gives the same noise after every reset().
+*/
+class DitherStage
+{
+public:
+    void prepare (int channels, uint32 newSeed = 0x5eed1234u)
+    {
+        numChannels = jmax (1, channels);
+        seed = newSeed;
+        errors.calloc ((size_t)numChannels);
+        reset();
+    }
+
+    /** Starts the noise over from the seed. */
+    void reset() noexcept
+    {
+        counter = 0;
+        errors.clear ((size_t)numChannels);
+    }
+
+    //==============================================================================
+
+    void process (float* const* channelData, int numSamples, int bits, bool dither, bool noiseShaping) noexcept
+    {
+        const float scale = (float)(1 << (jlimit (1, 24, bits) - 1));  // steps per unit
+        const float step = 1.0f / scale;
+        alignas (32) float noise[chunkSize];
+
+        for (int start = 0; start < numSamples; start += chunkSize) {
+            const int num = jmin ((int)chunkSize, numSamples - start);
+
+            for (int channel = 0; channel < numChannels; ++channel) {
+                float* data = channelData[channel] + start;
+
+                if (dither)
+                    fillTriangular (noise, num, getKey (channel), counter + (uint32)start);
+                else
+                    FloatVectorOperations::clear (noise, num);
+
+                if (noiseShaping) {
+                    //the error of each sample is subtracted from the next one, which moves it up in frequency
+                    float error = errors[channel];
+                    for (int i = 0; i < num; ++i) {
+                        const float target = data[i] - error;
+                        const float quantised = std::floor ((target + step * noise[i]) * scale + 0.5f) * step;
+                        error = quantised - target;
+                        data[i] = quantised;
+                    }
+                    errors[channel] = error;
+                }
+                else {
+                    for (int i = 0; i < num; ++i)
+                        data[i] = std::floor ((data[i] + step * noise[i]) * scale + 0.5f) * step;
+                }
+            }
+        }
+
+        counter += (uint32)numSamples;
+    }
+
+    //==============================================================================
+
+    /** Triangular noise in -1 .. 1, the sum of two uniforms drawn for counter .. counter + numSamples - 1. */
+    static void fillTriangular (float* dest, int numSamples, uint32 key, uint32 counter) noexcept
+    {
+        const float toUnit = 1.0f / 16777216.0f;
+
+        for (int i = 0; i < numSamples; ++i) {
+            const uint32 index = 2u * (counter + (uint32)i);
+            const float a = (float)(int)(hash (index ^ key) >> 8);
+            const float b = (float)(int)(hash ((index + 1u) ^ key) >> 8);
+            dest[i] = (a + b) * toUnit - 1.0f;
+        }
+    }
+
+private:
+    //==============================================================================
+
+    /** Chris Wellons' lowbias32, a bijection with good avalanche in a few integer ops. */
+    static uint32 hash (uint32 x) noexcept
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    uint32 getKey (int channel) const noexcept
+    {
+        return hash (seed + 0x9e3779b9u * (uint32)(channel + 1));
+    }
+
+    //==============================================================================
+
+    enum {
+        chunkSize = 256,
+    };
+
+    int numChannels = 1;
+    uint32 seed = 0;
+    uint32 counter = 0;         // samples since the last reset
+    HeapBlock<float> errors;    // noise shaping, one per channel
+};
+
+//==============================================================================
@@ -0,0 +1,100 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** Per channel peak follower that moves the operating point of the shapers.
+
+    Sag lowers the drive as the envelope rises, like a power supply that droops
+    under load. Bias adds a DC offset proportional to the envelope, which makes
+    every symmetric shaper asymmetric and brings in even harmonics on loud notes.
+
+    The rectification and the drive/bias map are plain vector loops. Only the
+    attack/release recursion is serial, and it selects its coefficient without a
+    branch.
+*/
+class EnvelopeFollower
+{
+public:
+    void prepare (int channels, double sampleRate)
+    {
+        numChannels = jmax (1, channels);
+        attack = (float)(1.0 - exp (-1.0 / (attackTime * sampleRate)));
+        release = (float)(1.0 - exp (-1.0 / (releaseTime * sampleRate)));
+        envelopes.calloc ((size_t)numChannels);
+    }
+
+    void reset() noexcept
+    {
+        envelopes.clear ((size_t)numChannels);
+    }
+
+    //==============================================================================
+
+    /** data = data / (1 + sagDepth sag env) + bias env, with sag and bias given per sample. */
+    void process (int channel, float* data, int numSamples, const float* sag, const float* bias) noexcept
+    {
+        alignas (32) float envelope[chunkSize];
+        float e = envelopes[channel];
+
+        for (int start = 0; start < numSamples; start += chunkSize) {
+            const int num = jmin ((int)chunkSize, numSamples - start);
+            float* block = data + start;
+
+            FloatVectorOperations::abs (envelope, block, num);
+
+            for (int i = 0; i < num; ++i) {
+                const float x = envelope[i];
+                const float coefficient = x > e ? attack : release;
+                e += coefficient * (x - e);
+                envelope[i] = e;
+            }
+
+            const float* blockSag = sag + start;
+            const float* blockBias = bias + start;
+            for (int i = 0; i < num; ++i)
+                block[i] = block[i] / (1.0f + sagDepth * blockSag[i] * envelope[i]) + blockBias[i] * envelope[i];
+        }
+
+        envelopes[channel] = e;
+    }
+
+private:
+    //==============================================================================
+
+    enum {
+        chunkSize = 256,
+    };
+
+    const double attackTime = 0.005;    // seconds
+    const double releaseTime = 0.1;     // seconds
+    const float sagDepth = 4.0f;        // full sag on a full scale envelope is -14 dB
+
+    int numChannels = 1;
+    float attack = 1.0f;
+    float release = 1.0f;
+    HeapBlock<float> envelopes;
+};
+
+//==============================================================================
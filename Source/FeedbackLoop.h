@@ -0,0 +1,147 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** Feeds the shaper output back to its input through a fractional delay.
+
+    The delayed signal is read with 3rd order Lagrange interpolation from a
+    power-of-two ring buffer and damped by a one pole lowpass. A slow DC
+    tracker is subtracted as well, otherwise an asymmetric or saturated loop
+    settles on a constant offset instead of ringing.
+
+    Because the delay is at least a few samples, the shapers do not have to run
+    sample by sample: a chunk of up to getChunkSize() samples only reads output
+    that was written before the chunk started, so the processor alternates
+    addFeedback(), the shapers on the whole chunk, and capture().
+*/
+class FeedbackLoop
+{
+public:
+    enum {
+        maxChunkSize = 64,
+    };
+
+    /** Allocates for maxDelaySamples, at the highest rate the shapers can run at. */
+    void prepare (int channels, int maxDelaySamples)
+    {
+        numChannels = jmax (1, channels);
+        const int size = nextPowerOfTwo (maxDelaySamples + 4);
+        buffer.setSize (numChannels, size);
+        mask = size - 1;
+        dampingStates.calloc ((size_t)numChannels);
+        dcStates.calloc ((size_t)numChannels);
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        buffer.clear();
+        dampingStates.clear ((size_t)numChannels);
+        dcStates.clear ((size_t)numChannels);
+        writePosition = 0;
+    }
+
+    int getMaxDelay() const noexcept { return mask - 3; }
+
+    /** The Lagrange taps reach one sample closer than the delay, the chunk must stop before them. */
+    static int getChunkSize (float delaySamples) noexcept
+    {
+        return jlimit (1, (int)maxChunkSize, (int)delaySamples - 1);
+    }
+
+    //==============================================================================
+
+    /** data += amount * (lowpass - dc) (delayed output), for one chunk of every channel.
+        damping and dcTracking are one pole coefficients.
+    */
+    void addFeedback (float* const* channelData, int numSamples, float delaySamples,
+                      float amount, float damping, float dcTracking) noexcept
+    {
+        const float delay = jlimit (2.0f, (float)getMaxDelay(), delaySamples);
+        const int whole = (int)delay;
+        const float d = delay - (float)whole + 1.0f;  // from the nearest tap, 1 .. 2
+
+        const float dm1 = d - 1.0f;
+        const float dm2 = d - 2.0f;
+        const float dm3 = d - 3.0f;
+        const float h0 = -dm1 * dm2 * dm3 * (1.0f / 6.0f);
+        const float h1 = d * dm2 * dm3 * 0.5f;
+        const float h2 = -d * dm1 * dm3 * 0.5f;
+        const float h3 = d * dm1 * dm2 * (1.0f / 6.0f);
+
+        jassert (numSamples <= getChunkSize (delay));
+
+        for (int channel = 0; channel < numChannels; ++channel) {
+            const float* line = buffer.getReadPointer (channel);
+            float* data = channelData[channel];
+            float state = dampingStates[channel];
+            float dc = dcStates[channel];
+
+            for (int i = 0; i < numSamples; ++i) {
+                const int nearest = writePosition + i - whole + 1;
+                const float delayed = h0 * line[nearest & mask]
+                                    + h1 * line[(nearest - 1) & mask]
+                                    + h2 * line[(nearest - 2) & mask]
+                                    + h3 * line[(nearest - 3) & mask];
+
+                state += damping * (delayed - state);
+                dc += dcTracking * (state - dc);
+                //a shaper with gain could otherwise run away inside the loop
+                data[i] += amount * jlimit (-maxLevel, maxLevel, state - dc);
+            }
+
+            dampingStates[channel] = state;
+            dcStates[channel] = dc;
+        }
+    }
+
+    /** Stores the shaper output of the chunk and moves on. */
+    void capture (const float* const* channelData, int numSamples) noexcept
+    {
+        for (int channel = 0; channel < numChannels; ++channel) {
+            float* line = buffer.getWritePointer (channel);
+            const float* data = channelData[channel];
+
+            for (int i = 0; i < numSamples; ++i)
+                line[(writePosition + i) & mask] = data[i];
+        }
+
+        writePosition = (writePosition + numSamples) & mask;
+    }
+
+private:
+    //==============================================================================
+
+    const float maxLevel = 4.0f;
+
+    int numChannels = 1;
+    AudioSampleBuffer buffer;
+    int mask = 0;
+    int writePosition = 0;
+    HeapBlock<float> dampingStates;
+    HeapBlock<float> dcStates;
+};
+
+//==============================================================================
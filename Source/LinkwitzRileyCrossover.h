@@ -0,0 +1,204 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "SoABiquad.h"
+
+//==============================================================================
+
+/** A tree of 4th order Linkwitz-Riley crossovers splitting up to four bands.
+
+    Every level of the tree runs all of its filters for all channels as one SoA
+    biquad pass. Branches that are not split at a given cutoff go through the
+    matching allpass instead, so the bands always sum back to an allpass response.
+*/
+class LinkwitzRileyCrossover
+{
+public:
+    enum {
+        maxBands = 4,
+        maxLevels = 3,
+        maxSections = 2,
+        maxFiltersPerLevel = 4,
+    };
+
+    //==============================================================================
+
+    /** Coefficients and routing of the tree, built off the audio thread. */
+    struct Layout
+    {
+        struct Level
+        {
+            int numFilters = 0;
+            int numSections = 0;
+            int source[maxFiltersPerLevel] = {};
+            SoABiquadCoefficients sections[maxSections];
+        };
+
+        int numBands = 1;
+        int numChannels = 0;
+        int numLevels = 0;
+        Level levels[maxLevels];
+
+        //==============================================================================
+
+        /** cutoffs holds numBands - 1 ascending frequencies. */
+        void build (int bands, const double* cutoffs, double sampleRate, int channels)
+        {
+            numBands = jlimit (1, (int)maxBands, bands);
+            numChannels = channels;
+            numLevels = 0;
+
+            if (numBands == 2) {
+                Level& split = addLevel (2, 2);
+                setLinkwitzRiley (split, 0, 0, cutoffs[0], sampleRate);
+            }
+            else if (numBands == 3) {
+                Level& split = addLevel (2, 2);
+                setLinkwitzRiley (split, 0, 0, cutoffs[0], sampleRate);
+
+                Level& bands3 = addLevel (3, 2);
+                setAllPass (bands3, 0, 0, cutoffs[1], sampleRate);
+                setLinkwitzRiley (bands3, 1, 1, cutoffs[1], sampleRate);
+            }
+            else if (numBands == 4) {
+                Level& split = addLevel (2, 2);
+                setLinkwitzRiley (split, 0, 0, cutoffs[1], sampleRate);
+
+                Level& compensation = addLevel (2, 1);
+                setAllPass (compensation, 0, 0, cutoffs[2], sampleRate);
+                setAllPass (compensation, 1, 1, cutoffs[0], sampleRate);
+
+                Level& bands4 = addLevel (4, 2);
+                setLinkwitzRiley (bands4, 0, 0, cutoffs[0], sampleRate);
+                setLinkwitzRiley (bands4, 2, 1, cutoffs[2], sampleRate);
+            }
+        }
+
+    private:
+        Level& addLevel (int numFilters, int numSections)
+        {
+            Level& level = levels[numLevels++];
+            level.numFilters = numFilters;
+            level.numSections = numSections;
+
+            for (int section = 0; section < numSections; ++section)
+                level.sections[section].allocate (numFilters * numChannels);
+
+            return level;
+        }
+
+        void setFilter (Level& level, int filter, int source, int section, const BiquadCoefficients& c)
+        {
+            level.source[filter] = source;
+            for (int channel = 0; channel < numChannels; ++channel)
+                level.sections[section].set (filter * numChannels + channel, c);
+        }
+
+        /** Lowpass into filter, highpass into filter + 1, both fed from source. */
+        void setLinkwitzRiley (Level& level, int filter, int source, double frequency, double sampleRate)
+        {
+            const double Q = MathConstants<double>::sqrt2 * 0.5;
+            const BiquadCoefficients lowPass = BiquadCoefficients::makeLowPass (sampleRate, frequency, Q);
+            const BiquadCoefficients highPass = BiquadCoefficients::makeHighPass (sampleRate, frequency, Q);
+
+            for (int section = 0; section < level.numSections; ++section) {
+                setFilter (level, filter, source, section, lowPass);
+                setFilter (level, filter + 1, source, section, highPass);
+            }
+        }
+
+        /** The sum of a LR4 lowpass and highpass is a 2nd order Butterworth allpass. */
+        void setAllPass (Level& level, int filter, int source, double frequency, double sampleRate)
+        {
+            const double Q = MathConstants<double>::sqrt2 * 0.5;
+            setFilter (level, filter, source, 0, BiquadCoefficients::makeAllPass (sampleRate, frequency, Q));
+
+            for (int section = 1; section < level.numSections; ++section)
+                setFilter (level, filter, source, section, BiquadCoefficients());
+        }
+    };
+
+    //==============================================================================
+
+    void prepare (int channels)
+    {
+        numChannels = channels;
+        const int numLanes = maxFiltersPerLevel * channels;
+
+        for (int level = 0; level < maxLevels; ++level) {
+            frames[level].calloc ((size_t)numLanes);
+            for (int section = 0; section < maxSections; ++section)
+                states[level][section].allocate (numLanes);
+        }
+        inputFrame.calloc ((size_t)jmax (1, channels));
+    }
+
+    void reset() noexcept
+    {
+        for (int level = 0; level < maxLevels; ++level)
+            for (int section = 0; section < maxSections; ++section)
+                states[level][section].reset();
+    }
+
+    //==============================================================================
+
+    /** bands holds layout.numBands * numChannels pointers, band after band. */
+    void process (const Layout& layout, const float* const* input, float* const* bands, int numSamples) noexcept
+    {
+        jassert (layout.numChannels == numChannels);
+
+        for (int i = 0; i < numSamples; ++i) {
+            for (int channel = 0; channel < numChannels; ++channel)
+                inputFrame[channel] = input[channel][i];
+
+            const float* previous = inputFrame;
+
+            for (int level = 0; level < layout.numLevels; ++level) {
+                const Layout::Level& l = layout.levels[level];
+                float* lanes = frames[level];
+
+                for (int filter = 0; filter < l.numFilters; ++filter)
+                    for (int channel = 0; channel < numChannels; ++channel)
+                        lanes[filter * numChannels + channel] = previous[l.source[filter] * numChannels + channel];
+
+                for (int section = 0; section < l.numSections; ++section)
+                    processSoABiquad (l.sections[section], states[level][section], lanes, 0, l.numFilters * numChannels);
+
+                previous = lanes;
+            }
+
+            for (int lane = 0; lane < layout.numBands * numChannels; ++lane)
+                bands[lane][i] = previous[lane];
+        }
+    }
+
+private:
+    //==============================================================================
+
+    int numChannels = 0;
+    HeapBlock<float> inputFrame;
+    HeapBlock<float> frames[maxLevels];
+    SoABiquadState states[maxLevels][maxSections];
+};
+
+//==============================================================================
@@ -0,0 +1,177 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** Channel linked brickwall limiter with lookahead.
+
+    The detector takes each sample and the midpoint to the next one, estimated
+    with 4 point interpolation, so the peaks between samples are caught as well.
+    A monotonic deque gives the window maximum of the detector in O(1), the
+    required gain falls instantly and recovers with the release time, and a
+    moving average across the lookahead turns the steps into ramps that are
+    complete when the peak leaves the delay line. The window is two samples
+    longer than the lookahead so both samples around a midpoint are covered.
+
+    All buffers are allocated in prepare().
+*/
+class LookaheadLimiter
+{
+public:
+    void prepare (int channels, double sampleRate)
+    {
+        numChannels = jmax (1, channels);
+        lookahead = jmax (1, roundToInt (lookaheadTime * sampleRate));
+        windowSize = lookahead + detectorDelay;
+        release = (float)(1.0 - exp (-1.0 / (releaseTime * sampleRate)));
+
+        delay.setSize (numChannels, getLatency());
+        history.malloc ((size_t)(numChannels * (detectorDelay + 1)));
+        dequeIndices.malloc ((size_t)windowSize);
+        dequePeaks.malloc ((size_t)windowSize);
+        averageGains.malloc ((size_t)lookahead);
+
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        delay.clear();
+        history.clear ((size_t)(numChannels * (detectorDelay + 1)));
+        delayPosition = 0;
+
+        dequeFront = 0;
+        dequeSize = 0;
+        sampleIndex = 0;
+
+        envelope = 1.0f;
+        for (int i = 0; i < lookahead; ++i)
+            averageGains[i] = 1.0f;
+        averageSum = (double)lookahead;
+        averagePosition = 0;
+    }
+
+    /** Lookahead plus the two samples the detector needs after each sample. */
+    int getLatency() const noexcept { return lookahead + detectorDelay; }
+
+    //==============================================================================
+
+    void process (float* const* channelData, int numSamples, float ceiling) noexcept
+    {
+        const int latency = getLatency();
+
+        for (int i = 0; i < numSamples; ++i) {
+            //detector for the sample two behind the input, h holds x[j - 1], x[j], x[j + 1]
+            float peak = 0.0f;
+            for (int channel = 0; channel < numChannels; ++channel) {
+                float* h = history + channel * (detectorDelay + 1);
+                const float x = channelData[channel][i];
+                const float midpoint = 0.5625f * (h[1] + h[2]) - 0.0625f * (h[0] + x);
+
+                peak = jmax (peak, std::abs (h[1]), std::abs (midpoint));
+                h[0] = h[1];
+                h[1] = h[2];
+                h[2] = x;
+            }
+
+            const float windowPeak = pushPeak (peak);
+            const float target = windowPeak > ceiling ? ceiling / windowPeak : 1.0f;
+            envelope = target < envelope ? target : envelope + release * (target - envelope);
+
+            averageSum += (double)(envelope - averageGains[averagePosition]);
+            averageGains[averagePosition] = envelope;
+            if (++averagePosition == lookahead)
+                averagePosition = 0;
+
+            const float gain = (float)(averageSum / (double)lookahead);
+
+            for (int channel = 0; channel < numChannels; ++channel) {
+                float* line = delay.getWritePointer (channel);
+                const float delayed = line[delayPosition];
+                line[delayPosition] = channelData[channel][i];
+                channelData[channel][i] = delayed * gain;
+            }
+
+            if (++delayPosition == latency)
+                delayPosition = 0;
+        }
+    }
+
+private:
+    //==============================================================================
+
+    /** Adds the newest peak and returns the largest one in the window. */
+    float pushPeak (float peak) noexcept
+    {
+        const uint32 index = sampleIndex++;
+
+        //drop the one that leaves the window from the front, this keeps room for the new one
+        if (dequeSize > 0 && index - dequeIndices[dequeFront] >= (uint32)windowSize) {
+            dequeFront = (dequeFront + 1) % windowSize;
+            --dequeSize;
+        }
+
+        //and the smaller peaks from the back, they can never be the maximum again
+        while (dequeSize > 0 && dequePeaks[(dequeFront + dequeSize - 1) % windowSize] <= peak)
+            --dequeSize;
+
+        const int back = (dequeFront + dequeSize) % windowSize;
+        dequeIndices[back] = index;
+        dequePeaks[back] = peak;
+        ++dequeSize;
+
+        return dequePeaks[dequeFront];
+    }
+
+    //==============================================================================
+
+    enum {
+        detectorDelay = 2,
+    };
+
+    const double lookaheadTime = 0.002;    // seconds
+    const double releaseTime = 0.1;        // seconds
+
+    int numChannels = 1;
+    int lookahead = 1;
+    int windowSize = 1;
+    float release = 1.0f;
+
+    AudioSampleBuffer delay;
+    int delayPosition = 0;
+    HeapBlock<float> history;  // numChannels * 3
+
+    HeapBlock<uint32> dequeIndices;
+    HeapBlock<float> dequePeaks;
+    int dequeFront = 0;
+    int dequeSize = 0;
+    uint32 sampleIndex = 0;
+
+    float envelope = 1.0f;
+    HeapBlock<float> averageGains;
+    double averageSum = 0.0;
+    int averagePosition = 0;
+};
+
+//==============================================================================
@@ -0,0 +1,96 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "ShaperKernels.h"
+
+//==============================================================================
+
+/** Encodes a stereo pair to mid and side, drives and shapes each with its own
+    kernel, and decodes back in place.
+
+    The pair is walked in chunks small enough to stay in cache: encoding and
+    drive are one loop into two stack buffers, then the two kernels run, then
+    decoding is one loop back into the channels. No other buffer is touched.
+*/
+class MidSideShaper
+{
+public:
+    /** Everything that can change from the message thread, swapped as one object. */
+    struct Setup
+    {
+        ShaperKernel midKernel = nullptr;
+        ShaperKernel sideKernel = nullptr;
+        float midDrive = 1.0f;
+        float sideDrive = 1.0f;
+        bool enabled = false;
+    };
+
+    //==============================================================================
+
+    void reset() noexcept
+    {
+        midState = ShaperState();
+        sideState = ShaperState();
+    }
+
+    void process (const Setup& setup, float* left, float* right, int numSamples, const ShaperContext& context) noexcept
+    {
+        alignas (32) float mid[chunkSize];
+        alignas (32) float side[chunkSize];
+
+        //the encoder halves, so decoding is a plain sum and difference
+        const float midGain = 0.5f * setup.midDrive;
+        const float sideGain = 0.5f * setup.sideDrive;
+
+        for (int start = 0; start < numSamples; start += chunkSize) {
+            const int num = jmin ((int)chunkSize, numSamples - start);
+            float* l = left + start;
+            float* r = right + start;
+
+            for (int i = 0; i < num; ++i) {
+                mid[i] = (l[i] + r[i]) * midGain;
+                side[i] = (l[i] - r[i]) * sideGain;
+            }
+
+            setup.midKernel (mid, num, midState, context);
+            setup.sideKernel (side, num, sideState, context);
+
+            for (int i = 0; i < num; ++i) {
+                l[i] = mid[i] + side[i];
+                r[i] = mid[i] - side[i];
+            }
+        }
+    }
+
+private:
+    //==============================================================================
+
+    enum {
+        chunkSize = 256,
+    };
+
+    ShaperState midState;
+    ShaperState sideState;
+};
+
+//==============================================================================
@@ -0,0 +1,190 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** A few LFOs, each routed to one target with a depth.
+
+    Every LFO is rendered as a whole block into its own vector, with the phase
+    computed from the sample index so the loops have no dependency between
+    samples. Targets get their modulation as multiply-adds of these vectors into
+    the per-sample ramp buffers of the processor.
+
+    Synced LFOs take their phase from the host position while it plays and
+    free run at the host tempo while it does not.
+*/
+class ModulationMatrix
+{
+public:
+    enum {
+        numLfos = 2,
+    };
+
+    enum Shape {
+        shapeSine = 0,
+        shapeTriangle,
+        shapeSampleAndHold,
+    };
+
+    enum Target {
+        targetOff = 0,
+        targetInputGain,
+        targetTone,
+        targetMix,
+        targetSag,
+        targetBias,
+        numTargets,
+    };
+
+    /** What the processor reads from the parameters once per block. */
+    struct Lfo
+    {
+        int shape = shapeSine;
+        float rate = 1.0f;              // Hz, when not synced
+        double beatsPerCycle = 0.0;     // 0 when not synced
+        int target = targetOff;
+        float depth = 0.0f;
+    };
+
+    //==============================================================================
+
+    void prepare (double newSampleRate, int maxBlockSize)
+    {
+        sampleRate = newSampleRate;
+        values.setSize (numLfos, maxBlockSize);
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        for (int lfo = 0; lfo < numLfos; ++lfo) {
+            phases[lfo] = 0.0;
+            held[lfo] = 0.0f;
+        }
+    }
+
+    //==============================================================================
+
+    void process (const Lfo* lfos, int numSamples, const AudioPlayHead::CurrentPositionInfo& position)
+    {
+        values.setSize (numLfos, numSamples, false, false, true);
+
+        for (int lfo = 0; lfo < numLfos; ++lfo) {
+            const Lfo& settings = lfos[lfo];
+            targets[lfo] = settings.depth != 0.0f ? settings.target : (int)targetOff;
+            depths[lfo] = settings.depth;
+            if (targets[lfo] == targetOff)
+                continue;
+
+            double cyclesPerSecond = settings.rate;
+            if (settings.beatsPerCycle > 0.0) {
+                const double bpm = position.bpm > 0.0 ? position.bpm : 120.0;
+                cyclesPerSecond = bpm / (60.0 * settings.beatsPerCycle);
+
+                if (position.isPlaying) {
+                    const double cycles = position.ppqPosition / settings.beatsPerCycle;
+                    phases[lfo] = cycles - std::floor (cycles);
+                }
+            }
+
+            const float increment = (float)(cyclesPerSecond / sampleRate);
+            render (lfo, settings.shape, values.getWritePointer (lfo), numSamples, increment);
+
+            const double end = phases[lfo] + (double)increment * numSamples;
+            phases[lfo] = end - std::floor (end);
+        }
+    }
+
+    bool isRouted (int target) const noexcept
+    {
+        for (int lfo = 0; lfo < numLfos; ++lfo)
+            if (targets[lfo] == target)
+                return true;
+        return false;
+    }
+
+    /** buffer += scale * depth * lfo, for every LFO routed to target. */
+    void addTo (int target, float* buffer, float scale, int numSamples) const noexcept
+    {
+        for (int lfo = 0; lfo < numLfos; ++lfo)
+            if (targets[lfo] == target)
+                FloatVectorOperations::addWithMultiply (buffer, values.getReadPointer (lfo), scale * depths[lfo], numSamples);
+    }
+
+private:
+    //==============================================================================
+
+    void render (int lfo, int shape, float* out, int numSamples, float increment) noexcept
+    {
+        const float start = (float)phases[lfo];
+
+        if (shape == shapeSampleAndHold) {
+            //a new value at every wrap, the runs in between are plain fills
+            float phase = start;
+            for (int i = 0; i < numSamples;) {
+                const int run = jlimit (1, numSamples - i, (int)std::ceil ((1.0f - phase) / jmax (increment, 1.0e-9f)));
+                FloatVectorOperations::fill (out + i, held[lfo], run);
+                i += run;
+                phase += increment * (float)run;
+
+                if (phase >= 1.0f) {
+                    phase -= 1.0f;
+                    held[lfo] = random.nextFloat() * 2.0f - 1.0f;
+                }
+            }
+            return;
+        }
+
+        for (int i = 0; i < numSamples; ++i) {
+            float phase = start + increment * (float)i;
+            phase -= (float)(int)phase;
+
+            if (shape == shapeTriangle) {
+                //starts at 0 going up, like the sine
+                float shifted = phase + 0.25f;
+                shifted -= (float)(int)shifted;
+                out[i] = 1.0f - 4.0f * std::abs (shifted - 0.5f);
+            }
+            else {
+                //parabolic sine with one correction step, within 0.1 %
+                const float x = 2.0f * phase - 1.0f;
+                const float y = 4.0f * x * (std::abs (x) - 1.0f);
+                out[i] = y + 0.225f * (y * std::abs (y) - y);
+            }
+        }
+    }
+
+    //==============================================================================
+
+    double sampleRate = 44100.0;
+    AudioSampleBuffer values;  // one block per LFO
+
+    double phases[numLfos] = {};
+    float held[numLfos] = {};
+    int targets[numLfos] = {};
+    float depths[numLfos] = {};
+    Random random;
+};
+
+//==============================================================================
@@ -0,0 +1,129 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LinkwitzRileyCrossover.h"
+#include "ShaperKernels.h"
+
+//==============================================================================
+
+/** Splits the input with a Linkwitz-Riley crossover tree, runs each band through
+    its own drive and shaper kernel, and sums the bands back together.
+
+    The filter and shaper states start over whenever the number of bands changes,
+    the old ones belong to a different split. New cutoffs alone keep them.
+*/
+class MultibandShaper
+{
+public:
+    enum {
+        maxBands = LinkwitzRileyCrossover::maxBands,
+    };
+
+    /** Everything that can change from the message thread, swapped as one object. */
+    struct Setup
+    {
+        struct Band
+        {
+            ShaperKernel kernel = nullptr;
+            float drive = 1.0f;
+        };
+
+        LinkwitzRileyCrossover::Layout crossover;
+        Band bands[maxBands];
+
+        int getNumBands() const noexcept { return crossover.numBands; }
+    };
+
+    //==============================================================================
+
+    void prepare (int channels, int maxBlockSize)
+    {
+        numChannels = channels;
+        crossover.prepare (channels);
+        bandBuffer.setSize (maxBands * jmax (1, channels), jmax (1, maxBlockSize));
+        bandPointers.malloc ((size_t)(maxBands * jmax (1, channels)));
+        inputPointers.malloc ((size_t)jmax (1, channels));
+        states.calloc ((size_t)(maxBands * jmax (1, channels)));
+    }
+
+    void reset() noexcept
+    {
+        crossover.reset();
+        std::fill (states.get(), states.get() + maxBands * jmax (1, numChannels), ShaperState());
+        lastNumBands = 0;
+    }
+
+    //==============================================================================
+
+    void process (const Setup& setup, float* const* channelData, int numSamples, const ShaperContext& context) noexcept
+    {
+        const int numBands = setup.getNumBands();
+        const int blockSize = bandBuffer.getNumSamples();
+
+        if (numBands != lastNumBands) {
+            reset();
+            lastNumBands = numBands;
+        }
+
+        for (int start = 0; start < numSamples; start += blockSize) {
+            const int num = jmin (blockSize, numSamples - start);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                inputPointers[channel] = channelData[channel] + start;
+            for (int lane = 0; lane < numBands * numChannels; ++lane)
+                bandPointers[lane] = bandBuffer.getWritePointer (lane);
+
+            crossover.process (setup.crossover, inputPointers, bandPointers, num);
+
+            for (int band = 0; band < numBands; ++band) {
+                const Setup::Band& b = setup.bands[band];
+
+                for (int channel = 0; channel < numChannels; ++channel) {
+                    float* data = bandPointers[band * numChannels + channel];
+                    FloatVectorOperations::multiply (data, b.drive, num);
+                    b.kernel (data, num, states[channel * maxBands + band], context);
+                }
+            }
+
+            for (int channel = 0; channel < numChannels; ++channel) {
+                float* out = channelData[channel] + start;
+                FloatVectorOperations::copy (out, bandPointers[channel], num);
+                for (int band = 1; band < numBands; ++band)
+                    FloatVectorOperations::add (out, bandPointers[band * numChannels + channel], num);
+            }
+        }
+    }
+
+private:
+    //==============================================================================
+
+    int numChannels = 0;
+    int lastNumBands = 0;
+    LinkwitzRileyCrossover crossover;
+    AudioSampleBuffer bandBuffer;
+    HeapBlock<float*> bandPointers;
+    HeapBlock<const float*> inputPointers;
+    HeapBlock<ShaperState> states;
+};
+
+//==============================================================================
@@ -0,0 +1,263 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** A single layer LSTM or GRU followed by a dense output, as trained by the
+    Automated-Guitar-Amp-Modelling scripts:
+
+        { "model_data": { "unit_type": "LSTM", "hidden_size": 20, "skip": 1 },
+          "state_dict": { "rec.weight_ih_l0": ..., "rec.weight_hh_l0": ...,
+                          "rec.bias_ih_l0": ..., "rec.bias_hh_l0": ...,
+                          "lin.weight": ..., "lin.bias": ... } }
+
+    Weights are stored column-major with every column padded to the SIMD width,
+    so the matrix-vector products run on whole SIMD registers. Loading allocates,
+    processing never does; the recurrent state belongs to the caller.
+*/
+class NeuralAmpModel
+{
+public:
+    enum {
+        maxHiddenSize = 40,
+        maxGates = 4,
+        maxRows = maxGates * maxHiddenSize,
+    };
+
+    enum class Type
+    {
+        lstm,
+        gru
+    };
+
+    typedef dsp::SIMDRegister<float> Vec;
+
+    //==============================================================================
+
+    /** Returns nullptr and fills error if the file is not a usable model. */
+    static std::unique_ptr<NeuralAmpModel> loadFromJson (const File& file, String& error)
+    {
+        if (! file.existsAsFile()) {
+            error = "Could not open the file";
+            return nullptr;
+        }
+
+        const var json = JSON::parse (file.loadFileAsString());
+        const var modelData = json["model_data"];
+        const var stateDict = json["state_dict"];
+
+        if (! modelData.isObject() || ! stateDict.isObject()) {
+            error = "Missing model_data or state_dict";
+            return nullptr;
+        }
+
+        const String unitType = modelData["unit_type"].toString().toUpperCase();
+        const int hidden = (int)modelData["hidden_size"];
+
+        if ((unitType != "LSTM" && unitType != "GRU") || ! isPositiveAndNotGreaterThan (hidden, (int)maxHiddenSize)) {
+            error = "Only LSTM and GRU layers with up to " + String ((int)maxHiddenSize) + " hidden units are supported";
+            return nullptr;
+        }
+
+        std::unique_ptr<NeuralAmpModel> model (new NeuralAmpModel (unitType == "LSTM" ? Type::lstm : Type::gru,
+                                                                   hidden, (int)modelData.getProperty ("skip", 0) != 0));
+        const int rows = model->numGates * hidden;
+
+        if (! model->readMatrix (stateDict["rec.weight_ih_l0"], rows, 1, model->inputWeights)
+         || ! model->readMatrix (stateDict["rec.weight_hh_l0"], rows, hidden, model->recurrentWeights)
+         || ! model->readVector (stateDict["rec.bias_ih_l0"], rows, model->inputBias)
+         || ! model->readVector (stateDict["rec.bias_hh_l0"], rows, model->recurrentBias)
+         || ! model->readDense (stateDict["lin.weight"], stateDict["lin.bias"])) {
+            error = "Weight shapes do not match a " + unitType + " with " + String (hidden) + " hidden units";
+            return nullptr;
+        }
+
+        //the LSTM only ever needs the sum of both biases
+        if (model->type == Type::lstm)
+            FloatVectorOperations::add (model->inputBias, model->recurrentBias, model->paddedRows);
+
+        return model;
+    }
+
+    //==============================================================================
+
+    Type getType() const noexcept { return type; }
+    int getHiddenSize() const noexcept { return hiddenSize; }
+    uint32 getSerial() const noexcept { return serial; }
+
+    /** h and c hold maxHiddenSize floats each and are updated in place. */
+    forcedinline float processSample (float x, float* h, float* c) const noexcept
+    {
+        alignas (32) float gates[maxRows];
+        alignas (32) float recurrent[maxRows];
+        const int N = hiddenSize;
+
+        if (type == Type::lstm) {
+            //gates = b + Wih x + Whh h, in i f g o order
+            multiply (x, h, inputBias, gates);
+
+            for (int i = 0; i < N; ++i) {
+                const float inputGate = sigmoid (gates[i]);
+                const float forgetGate = sigmoid (gates[N + i]);
+                const float cell = fastTanh (gates[2 * N + i]);
+                const float outputGate = sigmoid (gates[3 * N + i]);
+
+                c[i] = forgetGate * c[i] + inputGate * cell;
+                h[i] = outputGate * fastTanh (c[i]);
+            }
+        }
+        else {
+            //the candidate gate needs Whh h on its own, in r z n order
+            multiply (0.0f, h, recurrentBias, recurrent);
+
+            for (int i = 0; i < numGates * N; ++i)
+                gates[i] = inputBias[i] + inputWeights[i] * x;
+
+            for (int i = 0; i < N; ++i) {
+                const float reset = sigmoid (gates[i] + recurrent[i]);
+                const float update = sigmoid (gates[N + i] + recurrent[N + i]);
+                const float candidate = fastTanh (gates[2 * N + i] + reset * recurrent[2 * N + i]);
+
+                h[i] = (1.0f - update) * candidate + update * h[i];
+            }
+        }
+
+        float y = denseBias;
+        for (int i = 0; i < N; ++i)
+            y += denseWeights[i] * h[i];
+
+        return skip ? y + x : y;
+    }
+
+private:
+    //==============================================================================
+
+    NeuralAmpModel (Type t, int hidden, bool useSkip)
+        : type (t),
+          hiddenSize (hidden),
+          numGates (t == Type::lstm ? 4 : 3),
+          skip (useSkip)
+    {
+        static std::atomic<uint32> serialCounter { 0 };
+        serial = ++serialCounter;
+
+        const int vecSize = (int)Vec::size();
+        paddedRows = (numGates * hidden + vecSize - 1) / vecSize * vecSize;
+
+        //input column, recurrent matrix, two biases, dense weights, plus room to align
+        const int numFloats = paddedRows * (hidden + 3) + hidden + vecSize;
+        storage.calloc ((size_t)numFloats);
+
+        inputWeights = Vec::getNextSIMDAlignedPtr (storage.get());
+        recurrentWeights = inputWeights + paddedRows;
+        inputBias = recurrentWeights + paddedRows * hidden;
+        recurrentBias = inputBias + paddedRows;
+        denseWeights = recurrentBias + paddedRows;
+    }
+
+    /** out = bias + Wih x + Whh h, one SIMD register of rows at a time. */
+    forcedinline void multiply (float x, const float* h, const float* bias, float* out) const noexcept
+    {
+        const int vecSize = (int)Vec::size();
+
+        for (int row = 0; row < paddedRows; row += vecSize) {
+            Vec acc = Vec::fromRawArray (bias + row) + Vec::fromRawArray (inputWeights + row) * x;
+
+            for (int column = 0; column < hiddenSize; ++column)
+                acc += Vec::fromRawArray (recurrentWeights + column * paddedRows + row) * h[column];
+
+            acc.copyToRawArray (out + row);
+        }
+    }
+
+    static forcedinline float fastTanh (float x) noexcept
+    {
+        return dsp::FastMathApproximations::tanh (jlimit (-5.0f, 5.0f, x));
+    }
+
+    static forcedinline float sigmoid (float x) noexcept
+    {
+        return 0.5f * fastTanh (0.5f * x) + 0.5f;
+    }
+
+    //==============================================================================
+
+    bool readMatrix (const var& json, int rows, int columns, float* dest)
+    {
+        if (! json.isArray() || json.size() != rows)
+            return false;
+
+        for (int row = 0; row < rows; ++row) {
+            const var& values = json[row];
+            if (! values.isArray() || values.size() != columns)
+                return false;
+
+            for (int column = 0; column < columns; ++column)
+                dest[column * paddedRows + row] = (float)values[column];
+        }
+
+        return true;
+    }
+
+    bool readVector (const var& json, int size, float* dest)
+    {
+        if (! json.isArray() || json.size() != size)
+            return false;
+
+        for (int i = 0; i < size; ++i)
+            dest[i] = (float)json[i];
+
+        return true;
+    }
+
+    bool readDense (const var& weights, const var& bias)
+    {
+        if (! weights.isArray() || weights.size() != 1 || ! bias.isArray() || bias.size() != 1)
+            return false;
+
+        denseBias = (float)bias[0];
+        return readVector (weights[0], hiddenSize, denseWeights);
+    }
+
+    //==============================================================================
+
+    const Type type;
+    const int hiddenSize;
+    const int numGates;
+    const bool skip;
+    uint32 serial = 0;
+    int paddedRows = 0;
+
+    HeapBlock<float> storage;
+    float* inputWeights = nullptr;
+    float* recurrentWeights = nullptr;
+    float* inputBias = nullptr;
+    float* recurrentBias = nullptr;
+    float* denseWeights = nullptr;
+    float denseBias = 0.0f;
+
+    JUCE_DECLARE_NON_COPYABLE (NeuralAmpModel)
+};
+
+//==============================================================================
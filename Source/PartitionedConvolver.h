@@ -0,0 +1,404 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** Zero latency convolution with a non-uniformly partitioned impulse response.
+
+    The first headSize taps are a direct FIR. The rest is split into stages of
+    uniformly partitioned FFT convolution whose block size grows with the
+    distance into the response:
+
+        taps       0 ..   64   direct
+        taps      64 .. 1024   blocks of   64, on the audio thread
+        taps    1024 .. 8192   blocks of  512, on a worker thread
+        taps    8192 .. end    blocks of 4096, on a worker thread
+
+    A stage with block size B needs a full block of input before it can
+    produce anything, so its taps start at B at the earliest. The worker stages
+    start at 2B, which gives their thread one whole block of time: a block is
+    handed over when it is complete and its result is only needed when the
+    next one is. A host block longer than a stage block cuts that short, so the
+    audio thread gives a late worker a bounded moment; if it is still busy after
+    that, the stage plays a block of silence and counts an overrun.
+
+    Everything, including the threads, is created in the constructor, so the
+    object is built off the audio thread and swapped in as a whole.
+*/
+class PartitionedConvolver
+{
+public:
+    enum {
+        headSize = 64,
+        chunkSize = 64,  // the smallest block size, every stage boundary falls on a chunk end
+    };
+
+    /** Impulse channels are used round robin when there are fewer than numChannels. */
+    PartitionedConvolver (const AudioSampleBuffer& impulse, int channels)
+        : numChannels (jmax (1, channels))
+        , numImpulseChannels (jmax (1, impulse.getNumChannels()))
+        , length (impulse.getNumSamples())
+    {
+        const int blockSizes[] = { 64, 512, 4096 };
+        const int offsets[] = { 64, 1024, 8192 };
+        const bool onWorker[] = { false, true, true };
+
+        head.calloc ((size_t)(numImpulseChannels * headSize));
+        for (int c = 0; c < impulse.getNumChannels(); ++c)
+            for (int k = 0; k < jmin ((int)headSize, length); ++k)
+                head[c * headSize + headSize - 1 - k] = impulse.getSample (c, k);  // reversed for the dot product
+        headHistory.calloc ((size_t)(numChannels * 2 * headSize));
+
+        for (int s = 0; s < 3 && offsets[s] < length; ++s) {
+            const int end = s < 2 ? jmin (offsets[s + 1], length) : length;
+            stages.add (new Stage (impulse, numChannels, blockSizes[s], offsets[s], end, onWorker[s]));
+        }
+    }
+
+    int getLength() const noexcept { return length; }
+    int getNumChannels() const noexcept { return numChannels; }
+
+    /** Blocks a worker stage could not deliver in time, since construction. */
+    int getNumOverruns() const noexcept
+    {
+        int total = 0;
+        for (const Stage* stage : stages)
+            total += stage->overruns.load();
+        return total;
+    }
+
+    /** Clears the tail, on the audio thread when the stage is switched back on. */
+    void reset() noexcept
+    {
+        headHistory.clear ((size_t)(numChannels * 2 * headSize));
+        position = 0;
+
+        for (Stage* stage : stages)
+            stage->reset();
+    }
+
+    //==============================================================================
+
+    void process (float* const* channelData, int numSamples) noexcept
+    {
+        for (int start = 0; start < numSamples;) {
+            const int num = jmin ((int)chunkSize - position % chunkSize, numSamples - start);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                processChunk (channel, channelData[channel] + start, num);
+
+            position += num;
+            start += num;
+
+            for (Stage* stage : stages)
+                if (position % stage->blockSize == 0)
+                    stage->blockComplete();
+
+            position %= stages.size() > 0 ? stages.getLast()->blockSize : (int)chunkSize;
+        }
+    }
+
+private:
+    //==============================================================================
+
+    void processChunk (int channel, float* data, int num) noexcept
+    {
+        alignas (32) float input[chunkSize];
+        FloatVectorOperations::copy (input, data, num);
+
+        //direct head, the history holds every sample twice so the taps read one contiguous run
+        const float* taps = head + (channel % numImpulseChannels) * headSize;
+        float* history = headHistory + channel * 2 * headSize;
+        int p = position % headSize;
+
+        for (int i = 0; i < num; ++i) {
+            history[p] = input[i];
+            history[p + headSize] = input[i];
+
+            const float* recent = history + p + 1;
+            float sum = 0.0f;
+            for (int k = 0; k < headSize; ++k)
+                sum += taps[k] * recent[k];
+
+            data[i] = sum;
+            p = (p + 1) % headSize;
+        }
+
+        //the stages play their last result and collect the input for their next one
+        for (Stage* stage : stages) {
+            const int offset = position % stage->blockSize;
+            FloatVectorOperations::add (data, stage->playing.getReadPointer (channel, offset), num);
+            FloatVectorOperations::copy (stage->fifo.getWritePointer (channel, offset), input, num);
+        }
+    }
+
+    //==============================================================================
+
+    /** One uniformly partitioned convolution, overlap-add with FFTs of twice the block size. */
+    struct Stage
+    {
+        Stage (const AudioSampleBuffer& impulse, int channels, int size, int offset, int end, bool useWorker)
+            : blockSize (size)
+            , numBins (size + 1)
+            , numPartitions ((end - offset + size - 1) / size)
+            , numImpulseChannels (jmax (1, impulse.getNumChannels()))
+            , numChannels (channels)
+            , fft (roundToInt (std::log2 (2 * size)))
+        {
+            const int spectrumSize = 2 * numBins;
+            frame.calloc ((size_t)(4 * blockSize));
+            accumulator.calloc ((size_t)spectrumSize);
+
+            impulseSpectra.calloc ((size_t)(numImpulseChannels * numPartitions * spectrumSize));
+            for (int c = 0; c < impulse.getNumChannels(); ++c)
+                for (int k = 0; k < numPartitions; ++k) {
+                    FloatVectorOperations::clear (frame, 4 * blockSize);
+                    const int first = offset + k * blockSize;
+                    const int count = jmin (blockSize, end - first);
+                    FloatVectorOperations::copy (frame, impulse.getReadPointer (c, first), count);
+
+                    fft.performRealOnlyForwardTransform (frame, true);
+                    FloatVectorOperations::copy (impulseSpectra + (c * numPartitions + k) * spectrumSize, frame, spectrumSize);
+                }
+
+            inputSpectra.calloc ((size_t)(numChannels * numPartitions * spectrumSize));
+            overlap.setSize (numChannels, blockSize);
+            fifo.setSize (numChannels, blockSize);
+            playing.setSize (numChannels, blockSize);
+            overlap.clear();
+            fifo.clear();
+            playing.clear();
+
+            if (useWorker) {
+                handedOver.setSize (numChannels, blockSize);
+                result.setSize (numChannels, blockSize);
+                handedOver.clear();
+                result.clear();
+                worker.reset (new Worker (*this));
+                worker->startThread (8);
+            }
+        }
+
+        //==============================================================================
+
+        void reset() noexcept
+        {
+            fifo.clear();
+            playing.clear();
+
+            //a busy worker still owns the delay line, it is cleared at the next hand over instead
+            if (pending.load())
+                clearRequested = true;
+            else
+                clearConvolution();
+        }
+
+        /** Called on the audio thread each time the fifo is full. */
+        void blockComplete() noexcept
+        {
+            if (worker == nullptr) {
+                for (int channel = 0; channel < numChannels; ++channel)
+                    convolve (channel, fifo.getReadPointer (channel), playing.getWritePointer (channel));
+                return;
+            }
+
+            if (! waitForWorker()) {
+                ++overruns;
+                playing.clear();
+                return;
+            }
+
+            if (clearRequested) {
+                clearConvolution();
+                clearRequested = false;
+            }
+
+            for (int channel = 0; channel < numChannels; ++channel) {
+                FloatVectorOperations::copy (playing.getWritePointer (channel), result.getReadPointer (channel), blockSize);
+                FloatVectorOperations::copy (handedOver.getWritePointer (channel), fifo.getReadPointer (channel), blockSize);
+            }
+
+            pending.store (true);
+            worker->wakeEvent.signal();
+        }
+
+        /** True once the worker is idle, false if it is still busy after maxWorkerWait. */
+        bool waitForWorker() const noexcept
+        {
+            if (! pending.load())
+                return true;
+
+            const int64 deadline = Time::getHighResolutionTicks() + Time::secondsToHighResolutionTicks (maxWorkerWait);
+            while (pending.load()) {
+                if (Time::getHighResolutionTicks() > deadline)
+                    return false;
+                Thread::yield();
+            }
+            return true;
+        }
+
+        /** Only while the worker is idle. */
+        void clearConvolution() noexcept
+        {
+            inputSpectra.clear ((size_t)(numChannels * numPartitions * 2 * numBins));
+            delayLinePosition = 0;
+            overlap.clear();
+            result.clear();
+        }
+
+        void runHandedOver() noexcept
+        {
+            for (int channel = 0; channel < numChannels; ++channel)
+                convolve (channel, handedOver.getReadPointer (channel), result.getWritePointer (channel));
+        }
+
+        /** Adds one input block to the spectrum delay line and produces the next output block. */
+        void convolve (int channel, const float* input, float* output) noexcept
+        {
+            const int spectrumSize = 2 * numBins;
+            const int fftSize = 2 * blockSize;
+
+            FloatVectorOperations::copy (frame, input, blockSize);
+            FloatVectorOperations::clear (frame + blockSize, 3 * blockSize);
+            fft.performRealOnlyForwardTransform (frame, true);
+
+            float* channelSpectra = inputSpectra + channel * numPartitions * spectrumSize;
+            FloatVectorOperations::copy (channelSpectra + delayLinePosition * spectrumSize, frame, spectrumSize);
+
+            const float* channelImpulse = impulseSpectra + (channel % numImpulseChannels) * numPartitions * spectrumSize;
+            FloatVectorOperations::clear (accumulator, spectrumSize);
+
+            //the newest input block meets the first partition, the oldest the last
+            for (int k = 0; k < numPartitions; ++k) {
+                const int slot = (delayLinePosition - k + numPartitions) % numPartitions;
+                const float* x = channelSpectra + slot * spectrumSize;
+                const float* h = channelImpulse + k * spectrumSize;
+
+                for (int bin = 0; bin < spectrumSize; bin += 2) {
+                    accumulator[bin]     += x[bin] * h[bin]     - x[bin + 1] * h[bin + 1];
+                    accumulator[bin + 1] += x[bin] * h[bin + 1] + x[bin + 1] * h[bin];
+                }
+            }
+
+            FloatVectorOperations::copy (frame, accumulator, spectrumSize);
+            for (int bin = 1; bin < blockSize; ++bin) {
+                frame[2 * (fftSize - bin)] = frame[2 * bin];
+                frame[2 * (fftSize - bin) + 1] = -frame[2 * bin + 1];
+            }
+            fft.performRealOnlyInverseTransform (frame);
+
+            float* tail = overlap.getWritePointer (channel);
+            for (int i = 0; i < blockSize; ++i) {
+                output[i] = frame[i] + tail[i];
+                tail[i] = frame[blockSize + i];
+            }
+
+            //all channels share the delay line position, it moves after the last one
+            if (channel == numChannels - 1)
+                delayLinePosition = (delayLinePosition + 1) % numPartitions;
+        }
+
+        //==============================================================================
+
+        class Worker : public Thread
+        {
+        public:
+            Worker (Stage& owner)
+                : Thread ("Convolution stage " + String (owner.blockSize)), stage (owner)
+            {
+            }
+
+            ~Worker() override
+            {
+                signalThreadShouldExit();
+                wakeEvent.signal();
+                stopThread (1000);
+            }
+
+            void run() override
+            {
+                //the flags are per thread, the one in processBlock does not reach here
+                ScopedNoDenormals noDenormals;
+
+                while (! threadShouldExit()) {
+                    if (stage.pending.load()) {
+                        stage.runHandedOver();
+                        stage.pending.store (false);
+                    }
+                    else {
+                        wakeEvent.wait (100);
+                    }
+                }
+            }
+
+            WaitableEvent wakeEvent;
+
+        private:
+            Stage& stage;
+        };
+
+        //==============================================================================
+
+        const int blockSize;
+        const int numBins;
+        const int numPartitions;
+        const int numImpulseChannels;
+        const int numChannels;
+
+        dsp::FFT fft;
+        HeapBlock<float> frame;
+        HeapBlock<float> accumulator;
+        HeapBlock<float> impulseSpectra;  // numImpulseChannels * numPartitions * 2 * numBins
+        HeapBlock<float> inputSpectra;    // numChannels * numPartitions * 2 * numBins
+        int delayLinePosition = 0;
+
+        AudioSampleBuffer overlap;
+        AudioSampleBuffer fifo;
+        AudioSampleBuffer playing;
+
+        AudioSampleBuffer handedOver;
+        AudioSampleBuffer result;
+        std::atomic<bool> pending { false };
+        bool clearRequested = false;  // reset() came while the worker was busy
+        const double maxWorkerWait = 0.001;  // seconds
+        std::atomic<int> overruns { 0 };
+        std::unique_ptr<Worker> worker;  // last, so it stops before the buffers it uses go away
+    };
+
+    //==============================================================================
+
+    const int numChannels;
+    const int numImpulseChannels;
+    const int length;
+    int position = 0;  // shared by all channels, wraps at the largest block size
+
+    HeapBlock<float> head;          // reversed taps, headSize per impulse channel
+    HeapBlock<float> headHistory;   // 2 * headSize per channel
+
+    OwnedArray<Stage> stages;
+
+    JUCE_DECLARE_NON_COPYABLE (PartitionedConvolver)
+};
+
+//==============================================================================
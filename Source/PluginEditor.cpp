@@ -105,6 +105,33 @@ DistortionAudioProcessorEditor::DistortionAudioProcessorEditor (DistortionAudioP
 
     //======================================
 
+    const String modelPath = processor.getNeuralModelPath();
+    loadModelButton.setButtonText (modelPath.isEmpty() ? "Load neural model..." : File (modelPath).getFileName());
+    loadModelButton.onClick = [this] { chooseNeuralModel(); };
+    addAndMakeVisible (loadModelButton);
+    editorHeight += buttonHeight + editorPadding;
+
+    const String impulsePath = processor.getImpulseResponsePath();
+    loadImpulseButton.setButtonText (impulsePath.isEmpty() ? "Load cabinet IR..." : File (impulsePath).getFileName());
+    loadImpulseButton.onClick = [this] { chooseImpulseResponse(); };
+    addAndMakeVisible (loadImpulseButton);
+    editorHeight += buttonHeight + editorPadding;
+
+    curveEditor.setPoints (processor.getTransferCurvePoints());
+    curveEditor.onChange = [this] (const TransferCurve::Points& points, bool finished) { processor.setTransferCurve (points, finished); };
+    addAndMakeVisible (curveEditor);
+    editorHeight += curveEditorHeight + editorPadding;
+
+    expressionEditor.setText (processor.getShaperExpressionText(), dontSendNotification);
+    expressionEditor.onReturnKey = [this] { expressionChanged(); };
+    expressionEditor.onFocusLost = [this] { expressionChanged(); };
+    expressionLabel.attachToComponent (&expressionEditor, true);
+    addAndMakeVisible (expressionLabel);
+    addAndMakeVisible (expressionEditor);
+    editorHeight += textEditorHeight + editorPadding;
+
+    //======================================
+
     editorHeight += components.size() * editorPadding;
     setSize (editorWidth, editorHeight);
     
@@ -149,8 +176,60 @@ void DistortionAudioProcessorEditor::resized()
         r = r.removeFromBottom (r.getHeight() - editorPadding);
         //meter.setBounds (400, 100, 50, (getHeight()/8)*6);
     }
+    loadModelButton.setBounds (r.removeFromTop (buttonHeight));
+    r.removeFromTop (editorPadding);
+    loadImpulseButton.setBounds (r.removeFromTop (buttonHeight));
+    r.removeFromTop (editorPadding);
+    curveEditor.setBounds (r.removeFromTop (curveEditorHeight));
+    r.removeFromTop (editorPadding);
+    expressionEditor.setBounds (r.removeFromTop (textEditorHeight));
+    r.removeFromTop (editorPadding);
+
     meter.setBounds (r.removeFromRight (sidebarWidth));
 
 }
 
+void DistortionAudioProcessorEditor::chooseNeuralModel()
+{
+    modelChooser.reset (new FileChooser ("Load neural model", File(), "*.json"));
+
+    modelChooser->launchAsync (FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles,
+                               [this] (const FileChooser& chooser)
+                               {
+                                   const File file = chooser.getResult();
+                                   if (file.existsAsFile()) {
+                                       processor.loadNeuralModel (file);
+                                       loadModelButton.setButtonText (file.getFileName());
+                                   }
+                               });
+}
+
+void DistortionAudioProcessorEditor::chooseImpulseResponse()
+{
+    impulseChooser.reset (new FileChooser ("Load cabinet impulse response", File(), "*.wav;*.aif;*.aiff;*.flac"));
+
+    impulseChooser->launchAsync (FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles,
+                                 [this] (const FileChooser& chooser)
+                                 {
+                                     const File file = chooser.getResult();
+                                     if (file.existsAsFile()) {
+                                         processor.loadImpulseResponse (file);
+                                         loadImpulseButton.setButtonText (file.getFileName());
+                                     }
+                                 });
+}
+
+void DistortionAudioProcessorEditor::expressionChanged()
+{
+    //a formula that does not compile is shown in red with the reason as tooltip
+    const String error = processor.setShaperExpression (expressionEditor.getText());
+    if (error.isEmpty())
+        expressionEditor.removeColour (TextEditor::textColourId);
+    else
+        expressionEditor.setColour (TextEditor::textColourId, Colours::red);
+
+    expressionEditor.applyColourToAllText (expressionEditor.findColour (TextEditor::textColourId));
+    expressionEditor.setTooltip (error);
+}
+
 //==============================================================================
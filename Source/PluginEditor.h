@@ -30,6 +30,7 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "PluginProcessor.h"
+#include "TransferCurveEditor.h"
 
 //==============================================================================
 
@@ -62,6 +63,8 @@ private:
         buttonHeight = 25,
         comboBoxHeight = 25,
         labelWidth = 100,
+        curveEditorHeight = 150,
+        textEditorHeight = 25,
     };
 
     //======================================
@@ -81,6 +84,23 @@ private:
     OwnedArray<ButtonAttachment> buttonAttachments;
     OwnedArray<ComboBoxAttachment> comboBoxAttachments;
 
+    //======================================
+
+    TextButton loadModelButton;
+    std::unique_ptr<FileChooser> modelChooser;
+    void chooseNeuralModel();
+
+    TextButton loadImpulseButton;
+    std::unique_ptr<FileChooser> impulseChooser;
+    void chooseImpulseResponse();
+
+    TransferCurveEditor curveEditor;
+
+    TextEditor expressionEditor;
+    Label expressionLabel { "Expression", "Expression" };
+    void expressionChanged();
+    TooltipWindow tooltipWindow { this };
+
     //==============================================================================
     foleys::LevelMeterLookAndFeel lnf;
     foleys::LevelMeter meter { foleys::LevelMeter::Minimal }; // See foleys::LevelMeter::MeterFlags for options
@@ -29,6 +29,28 @@
 #include "PluginParameter.h"
 
 
+//==============================================================================
+
+//start .. end linearly over the block, the same steps as applyGainRamp
+static void fillRamp (float* dest, float start, float end, int numSamples) noexcept
+{
+    const float increment = (end - start) / (float)numSamples;
+
+    for (int i = 0; i < numSamples; ++i)
+        dest[i] = start + increment * (float)i;
+}
+
+//wet = dry + mix * (wet - dry), with mix given per sample
+static void mixWithDry (float* wet, const float* dry, const float* mix, int numSamples) noexcept
+{
+    FloatVectorOperations::subtract (wet, dry, numSamples);
+    FloatVectorOperations::multiply (wet, mix, numSamples);
+    FloatVectorOperations::add (wet, dry, numSamples);
+}
+
+//beats per LFO cycle for each entry of lfoSyncItemsUI, 0 runs free
+static const double lfoSyncBeats[] = { 0.0, 4.0, 2.0, 1.0, 0.5, 0.25 };
+
 //==============================================================================
 
 DistortionAudioProcessor::DistortionAudioProcessor():
@@ -37,25 +59,139 @@ DistortionAudioProcessor::DistortionAudioProcessor():
                     #if ! JucePlugin_IsMidiEffect
                      #if ! JucePlugin_IsSynth
                       .withInput  ("Input",  AudioChannelSet::stereo(), true)
+                      .withInput  ("Sidechain", AudioChannelSet::stereo(), false)
                      #endif
                       .withOutput ("Output", AudioChannelSet::stereo(), true)
                     #endif
                    ),
 #endif
     parameters (*this)
-    , paramDistortionType (parameters, "Distortion type", distortionTypeItemsUI, distortionTypeFullWaveRectifier)
+    , paramDistortionType (parameters, "Distortion type", distortionTypeItemsUI, distortionTypeFullWaveRectifier,
+                           [this](float value){ triggerAsyncUpdate(); return value; })
     , paramInputGain (parameters, "Input gain", "dB", -24.0f, 12.0f, 0.0f,
                       [](float value){ return powf (10.0f, value * 0.05f); })
     , paramOutputGain (parameters, "Output gain", "dB", -24.0f, 12.0f, -24.0f,
                        [](float value){ return powf (10.0f, value * 0.05f); })
     , paramTone (parameters, "Tone", "dB", -24.0f, 12.0f, 0.0f,
-                 [this](float value){ paramTone.setCurrentAndTargetValue (value); updateFilters(); return value; })
+                 [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramChainStages (parameters, "Chain stages", chainStagesItemsUI, 0,
+                        [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramChainMode (parameters, "Chain mode", chainModeItemsUI, chainModeSerial,
+                      [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramStage2Type (parameters, "Stage 2 type", distortionTypeItemsUI, distortionTypeSoftClipping,
+                       [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramStage3Type (parameters, "Stage 3 type", distortionTypeItemsUI, distortionTypeHardClipping,
+                       [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramStage4Type (parameters, "Stage 4 type", distortionTypeItemsUI, distortionTypeSlewLimiter,
+                       [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramStage1Gain (parameters, "Stage 1 gain", "dB", -24.0f, 12.0f, 0.0f,
+                       [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramStage2Gain (parameters, "Stage 2 gain", "dB", -24.0f, 12.0f, 0.0f,
+                       [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramStage3Gain (parameters, "Stage 3 gain", "dB", -24.0f, 12.0f, 0.0f,
+                       [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramStage4Gain (parameters, "Stage 4 gain", "dB", -24.0f, 12.0f, 0.0f,
+                       [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramBands (parameters, "Bands", bandsItemsUI, 0,
+                  [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramCrossoverLow (parameters, "Crossover low", "Hz", 40.0f, 1000.0f, 200.0f,
+                         [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramCrossoverMid (parameters, "Crossover mid", "Hz", 200.0f, 5000.0f, 1000.0f,
+                         [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramCrossoverHigh (parameters, "Crossover high", "Hz", 1000.0f, 16000.0f, 5000.0f,
+                          [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramBand1Type (parameters, "Band 1 type", distortionTypeItemsUI, distortionTypeSoftClipping,
+                      [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramBand2Type (parameters, "Band 2 type", distortionTypeItemsUI, distortionTypeSoftClipping,
+                      [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramBand3Type (parameters, "Band 3 type", distortionTypeItemsUI, distortionTypeSoftClipping,
+                      [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramBand4Type (parameters, "Band 4 type", distortionTypeItemsUI, distortionTypeSoftClipping,
+                      [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramBand1Drive (parameters, "Band 1 drive", "dB", -24.0f, 24.0f, 0.0f,
+                       [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramBand2Drive (parameters, "Band 2 drive", "dB", -24.0f, 24.0f, 0.0f,
+                       [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramBand3Drive (parameters, "Band 3 drive", "dB", -24.0f, 24.0f, 0.0f,
+                       [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramBand4Drive (parameters, "Band 4 drive", "dB", -24.0f, 24.0f, 0.0f,
+                       [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramMix (parameters, "Mix", "%", 0.0f, 100.0f, 100.0f,
+                [](float value){ return value * 0.01f; })
+    , paramAutoGain (parameters, "Auto gain")
+    , paramDiodeSolver (parameters, "Diode solver", solverItemsUI, solverNewtonRaphson,
+                        [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramOversampling (parameters, "Oversampling", oversamplingItemsUI, oversamplingOff,
+                         [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramTapeSolver (parameters, "Tape solver", tapeSolverItemsUI, tapeSolverRK2,
+                       [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramSpectral (parameters, "Spectral", spectralItemsUI, spectralOff,
+                     [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramFftSize (parameters, "FFT size", fftSizeItemsUI, 1,
+                    [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramSag (parameters, "Sag", "%", 0.0f, 100.0f, 0.0f,
+                [](float value){ return value * 0.01f; })
+    , paramBias (parameters, "Bias", "%", 0.0f, 100.0f, 0.0f,
+                 [this](float value){ triggerAsyncUpdate(); return value * 0.01f; })
+    , paramEmphasis (parameters, "Emphasis", "dB", -18.0f, 18.0f, 0.0f,
+                     [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramEmphasisFrequency (parameters, "Emphasis frequency", "Hz", 100.0f, 8000.0f, 1000.0f,
+                              [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramSidechain (parameters, "Sidechain", sidechainItemsUI, sidechainOff)
+    , paramSidechainDepth (parameters, "Sidechain depth", "%", -100.0f, 100.0f, -100.0f,
+                           [](float value){ return value * 0.01f; })
+    , paramStereoMode (parameters, "Stereo mode", stereoModeItemsUI, stereoModeLeftRight,
+                       [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramMidType (parameters, "Mid type", distortionTypeItemsUI, distortionTypeSoftClipping,
+                    [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramSideType (parameters, "Side type", distortionTypeItemsUI, distortionTypeSoftClipping,
+                     [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramMidDrive (parameters, "Mid drive", "dB", -24.0f, 24.0f, 0.0f,
+                     [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramSideDrive (parameters, "Side drive", "dB", -24.0f, 24.0f, 0.0f,
+                      [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramParallelChannels (parameters, "Parallel channels", false,
+                             [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramLimiter (parameters, "Limiter", false,
+                    [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramLimiterCeiling (parameters, "Limiter ceiling", "dB", -12.0f, 0.0f, -1.0f,
+                           [](float value){ return powf (10.0f, value * 0.05f); })
+    , paramCabinet (parameters, "Cabinet")
+    , paramLfo1Shape (parameters, "LFO 1 shape", lfoShapeItemsUI, ModulationMatrix::shapeSine)
+    , paramLfo1Rate (parameters, "LFO 1 rate", "Hz", 0.05f, 20.0f, 1.0f)
+    , paramLfo1Sync (parameters, "LFO 1 sync", lfoSyncItemsUI, 0)
+    , paramLfo1Target (parameters, "LFO 1 target", lfoTargetItemsUI, ModulationMatrix::targetOff,
+                       [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramLfo1Depth (parameters, "LFO 1 depth", "%", -100.0f, 100.0f, 50.0f,
+                      [](float value){ return value * 0.01f; })
+    , paramLfo2Shape (parameters, "LFO 2 shape", lfoShapeItemsUI, ModulationMatrix::shapeTriangle)
+    , paramLfo2Rate (parameters, "LFO 2 rate", "Hz", 0.05f, 20.0f, 0.25f)
+    , paramLfo2Sync (parameters, "LFO 2 sync", lfoSyncItemsUI, 0)
+    , paramLfo2Target (parameters, "LFO 2 target", lfoTargetItemsUI, ModulationMatrix::targetOff,
+                       [this](float value){ triggerAsyncUpdate(); return value; })
+    , paramLfo2Depth (parameters, "LFO 2 depth", "%", -100.0f, 100.0f, 50.0f,
+                      [](float value){ return value * 0.01f; })
+    , paramFeedback (parameters, "Feedback", "%", 0.0f, 95.0f, 0.0f,
+                     [](float value){ return value * 0.01f; })
+    , paramFeedbackDelay (parameters, "Feedback delay", "ms", 0.1f, 50.0f, 5.0f)
+    , paramFeedbackDamping (parameters, "Feedback damping", "%", 0.0f, 100.0f, 30.0f,
+                            [](float value){ return value * 0.01f; })
+    , paramQuantize (parameters, "Quantize", quantizeItemsUI, quantizeOff)
+    , paramQuantizeBits (parameters, "Quantize bits", "bits", 2.0f, 24.0f, 8.0f)
 {
     parameters.apvts.state = ValueTree (Identifier (getName().removeCharacters ("- ")));
+    transferCurve.publish (std::unique_ptr<TransferCurve> (new TransferCurve (TransferCurve::getDefaultPoints())));
+    setShaperExpression (getShaperExpressionText());
+    updateShaperChain();
+    updateMultiband();
+    updateMidSide();
+    updateFilters();
 }
 
 DistortionAudioProcessor::~DistortionAudioProcessor()
 {
+    cancelPendingUpdate();
+    loaderPool.removeAllJobs (true, 5000);
 }
 
 //==============================================================================
@@ -70,15 +206,88 @@ void DistortionAudioProcessor::prepareToPlay (double sampleRate, int samplesPerB
 
     //======================================
 
-    filters.clear();
-    for (int i = 0; i < getTotalNumInputChannels(); ++i) {
-        Filter* filter;
-        filters.add (filter = new Filter());
-    }
+    toneStage.prepare (getMainBusNumInputChannels());
     updateFilters();
     
     //======================================
-    
+
+    const int numChannels = jmax (1, getMainBusNumInputChannels());
+    const int oversamplingFactor = 2;
+
+    oversampler.reset (new dsp::Oversampling<float> ((size_t)numChannels, 1,
+                                                     dsp::Oversampling<float>::filterHalfBandPolyphaseIIR,
+                                                     true, true));
+    oversampler->initProcessing ((size_t)samplesPerBlock);
+    oversamplerLatency = roundToInt (oversampler->getLatencyInSamples());
+    oversampledChannels.malloc ((size_t)numChannels);
+    wasOversampling = (int)paramOversampling.getTargetValue() == oversampling2x;
+
+    shaperContext.prepare (sampleRate);
+    oversampledContext.prepare (sampleRate * oversamplingFactor);
+    shaperStates.calloc ((size_t)(numChannels * ShaperChain::maxStages));
+    //one worker per extra channel, as far as there are cores for them
+    channelPoolSize = jmax (0, jmin (SystemStats::getNumCpus() - 1, numChannels - 1));
+    shaperScratch.setSize (2 * (channelPoolSize + 1), samplesPerBlock * oversamplingFactor);
+    updateChannelPool();
+    updateShaperChain();
+
+    multiband.prepare (getMainBusNumInputChannels(), samplesPerBlock * oversamplingFactor);
+    multibandWasOn = false;
+    updateMultiband();
+
+    midSide.reset();
+    midSideWasOn = false;
+    updateMidSide();
+
+    spectral.prepare (getMainBusNumInputChannels());
+    spectralMode = spectralOff;
+
+    feedback.prepare (numChannels, (int)std::ceil (maxFeedbackDelay * maxFeedbackSampleRate));
+    feedbackChannels.malloc ((size_t)numChannels);
+    feedbackWasOn = false;
+    feedbackSampleRate = sampleRate;
+    lastFeedbackDelay = paramFeedbackDelay.getTargetValue();
+
+    //a fixed seed and a reset here make offline renders repeat exactly
+    dither.prepare (numChannels);
+    ditherWasOn = false;
+
+    //======================================
+
+    //resampling and partitioning a long response takes a while, the old convolver plays until it is done
+    loaderPool.addJob ([this] { updateConvolver(); });
+    cabinetWasOn = false;
+
+    limiter.prepare (getMainBusNumOutputChannels(), sampleRate);
+    limiterWasOn = false;
+
+    wetLatency = getWetPathLatency (wasOversampling);
+    setLatencySamples (getReportedLatency (wasOversampling));
+
+    dryDelay.prepare (getMainBusNumInputChannels(), oversamplerLatency + SpectralShaper::maxFftSize);
+    dryDelay.setDelay (wetLatency);
+    dryBuffer.setSize (getMainBusNumInputChannels(), samplesPerBlock);
+    lastMix = paramMix.getTargetValue();
+
+    autoGain.prepare (getMainBusNumInputChannels(), sampleRate);
+
+    envelope.prepare (getMainBusNumInputChannels(), sampleRate);
+    lastSag = paramSag.getTargetValue();
+    lastBias = paramBias.getTargetValue();
+
+    //size the meter here rather than on the audio thread, with its default rms window
+    meterSource.resize (getMainBusNumOutputChannels(), 8);
+
+    sidechain.prepare (sampleRate);
+    sidechainLevels.malloc ((size_t)SidechainFollower::getNumLevels (jmax (1, samplesPerBlock)));
+    sidechainCurves.setSize (2, samplesPerBlock);
+    lastSidechainGain = 1.0f;
+    lastSidechainMix = 1.0f;
+
+    modulation.prepare (sampleRate, samplesPerBlock);
+    modulationBuffers.setSize (ModulationMatrix::numTargets, samplesPerBlock);
+
+    preparedBlockSize = jmax (1, samplesPerBlock);
 }
 
 void DistortionAudioProcessor::releaseResources()
@@ -89,150 +298,734 @@ void DistortionAudioProcessor::releaseResources()
 void DistortionAudioProcessor::processBlock (AudioSampleBuffer& buffer, MidiBuffer& midiMessages)
 {
     ScopedNoDenormals noDenormals;
-    const int numInputChannels = getTotalNumInputChannels();
-    const int numOutputChannels = getTotalNumOutputChannels();
     const int numSamples = buffer.getNumSamples();
-    
+
+    //a host may pass more than it announced, every buffer below is only sized for that much
+    for (int start = 0; start < numSamples; start += preparedBlockSize) {
+        AudioSampleBuffer chunk (buffer.getArrayOfWritePointers(), buffer.getNumChannels(),
+                                 start, jmin (preparedBlockSize, numSamples - start));
+        processChunk (chunk);
+    }
+}
+
+void DistortionAudioProcessor::processChunk (AudioSampleBuffer& buffer)
+{
+    const int numInputChannels = getMainBusNumInputChannels();
+    const int numOutputChannels = getMainBusNumOutputChannels();
+    const int numSamples = buffer.getNumSamples();
+
+    //======================================
+
+    //the sidechain level scales the input gain or the mix, ramped between its sub-block levels
+    const int sidechainTarget = (int)paramSidechain.getTargetValue();
+    const int numSidechainChannels = getChannelCountOfBus (true, 1);
+    const bool sidechainOn = sidechainTarget != sidechainOff && numSidechainChannels > 0;
+    const int numSidechainLevels = SidechainFollower::getNumLevels (numSamples);
+    if (sidechainOn) {
+        const AudioSampleBuffer sidechainBuffer = getBusBuffer (buffer, true, 1);
+        sidechain.process (sidechainBuffer.getArrayOfReadPointers(), numSidechainChannels, numSamples, sidechainLevels);
+    }
+    else {
+        sidechain.reset();
+    }
+
+    const bool gainDriven = sidechainOn && sidechainTarget == sidechainInputGain;
+    const bool mixDriven = sidechainOn && sidechainTarget == sidechainMix;
+    const bool sidechainGainOn = gainDriven || lastSidechainGain != 1.0f;
+    const bool sidechainMixOn = mixDriven || lastSidechainMix != 1.0f;
+    float* sidechainGains = sidechainCurves.getWritePointer (0);
+    float* sidechainMixes = sidechainCurves.getWritePointer (1);
+
+    //a target that is no longer driven goes back to 1 across the block
+    if (sidechainGainOn && ! gainDriven) {
+        fillRamp (sidechainGains, lastSidechainGain, 1.0f, numSamples);
+        lastSidechainGain = 1.0f;
+    }
+    if (sidechainMixOn && ! mixDriven) {
+        fillRamp (sidechainMixes, lastSidechainMix, 1.0f, numSamples);
+        lastSidechainMix = 1.0f;
+    }
+
+    if (gainDriven || mixDriven) {
+        const float depth = paramSidechainDepth.getTargetValue();
+        float* curve = gainDriven ? sidechainGains : sidechainMixes;
+        float& last = gainDriven ? lastSidechainGain : lastSidechainMix;
+
+        for (int index = 0; index < numSidechainLevels; ++index) {
+            const float factor = SidechainFollower::getFactor (sidechainLevels[index], depth);
+            const float value = gainDriven ? Decibels::decibelsToGain (sidechainGainRange * (factor - 1.0f)) : factor;
+
+            const int start = index * SidechainFollower::subBlockSize;
+            fillRamp (curve + start, last, value, jmin ((int)SidechainFollower::subBlockSize, numSamples - start));
+            last = value;
+        }
+    }
+
+    //the LFOs render one vector each per block, the targets add them to their ramps below
+    const ModulationMatrix::Lfo lfos[ModulationMatrix::numLfos] = {
+        { (int)paramLfo1Shape.getTargetValue(), paramLfo1Rate.getTargetValue(), lfoSyncBeats[(int)paramLfo1Sync.getTargetValue()],
+          (int)paramLfo1Target.getTargetValue(), paramLfo1Depth.getTargetValue() },
+        { (int)paramLfo2Shape.getTargetValue(), paramLfo2Rate.getTargetValue(), lfoSyncBeats[(int)paramLfo2Sync.getTargetValue()],
+          (int)paramLfo2Target.getTargetValue(), paramLfo2Depth.getTargetValue() },
+    };
+
+    AudioPlayHead::CurrentPositionInfo position;
+    position.resetToDefault();
+    if (AudioPlayHead* playHead = getPlayHead())
+        playHead->getCurrentPosition (position);
+
+    modulation.process (lfos, numSamples, position);
+
+    const float inputGainStart = paramInputGain.getCurrentValue();
+    const float inputGainEnd = paramInputGain.skip (numSamples);
+    const float outputGainStart = paramOutputGain.getCurrentValue();
+    const float outputGainEnd = paramOutputGain.skip (numSamples);
+
+    const bool oversample = (int)paramOversampling.getTargetValue() == oversampling2x;
+    if (oversample != wasOversampling) {
+        if (oversample)
+            oversampler->reset();
+        wasOversampling = oversample;
+    }
+
+    const int newSpectralMode = (int)paramSpectral.getTargetValue();
+    if (newSpectralMode != spectralOff && spectralMode == spectralOff)
+        spectral.reset();
+    spectral.setSize ((int)paramFftSize.getTargetValue());
+    spectralMode = newSpectralMode;
+
+    const int latency = getWetPathLatency (oversample);
+    if (latency != wetLatency) {
+        wetLatency = latency;
+        dryDelay.setDelay (wetLatency);
+    }
+
+    const float mixStart = lastMix;
+    const float mixEnd = paramMix.getTargetValue();
+    const bool needsDry = mixStart < 1.0f || mixEnd < 1.0f || sidechainMixOn || modulation.isRouted (ModulationMatrix::targetMix);
+    float* mix = needsDry ? getModulatedRamp (ModulationMatrix::targetMix, mixStart, mixEnd, 1.0f, 0.0f, 1.0f, numSamples) : nullptr;
+    if (sidechainMixOn)
+        FloatVectorOperations::multiply (mix, sidechainMixes, numSamples);
+    lastMix = mixEnd;
+
+    //keep the delay line running while fully wet so a later mix change starts from fresh samples
+    if (needsDry || wetLatency > 0) {
+        for (int channel = 0; channel < numInputChannels; ++channel)
+            dryDelay.process (channel, buffer.getReadPointer (channel), dryBuffer.getWritePointer (channel), numSamples);
+        dryDelay.advance (numSamples);
+    }
+
+    const bool autoGainOn = paramAutoGain.getTargetValue() > 0.5f;
+    if (autoGainOn) {
+        if (! autoGainWasOn)
+            autoGain.reset();
+
+        autoGain.beginBlock (numSamples);
+        for (int channel = 0; channel < numInputChannels; ++channel)
+            autoGain.measureInput (channel, buffer.getReadPointer (channel), numSamples);
+    }
+    autoGainWasOn = autoGainOn;
+
+    if (sidechainGainOn || modulation.isRouted (ModulationMatrix::targetInputGain)) {
+        //the gain ramp times 1 + lfo times the sidechain, built once and applied to every channel
+        float* gains = getModulatedRamp (ModulationMatrix::targetInputGain, 1.0f, 1.0f, 1.0f, 0.0f, 2.0f, numSamples);
+        const float increment = (inputGainEnd - inputGainStart) / (float)numSamples;
+        for (int i = 0; i < numSamples; ++i)
+            gains[i] *= inputGainStart + increment * (float)i;
+        if (sidechainGainOn)
+            FloatVectorOperations::multiply (gains, sidechainGains, numSamples);
+
+        for (int channel = 0; channel < numInputChannels; ++channel)
+            FloatVectorOperations::multiply (buffer.getWritePointer (channel), gains, numSamples);
+    }
+    else {
+        for (int channel = 0; channel < numInputChannels; ++channel)
+            buffer.applyGainRamp (channel, 0, numSamples, inputGainStart, inputGainEnd);
+    }
+
+    const ToneStage::Setup* tone = toneSetup.acquire();
+    toneStage.processPre (*tone, buffer.getArrayOfWritePointers(), numSamples);
+
+    const float sagStart = lastSag;
+    const float sagEnd = paramSag.getTargetValue();
+    const float biasStart = lastBias;
+    const float biasEnd = paramBias.getTargetValue();
+    lastSag = sagEnd;
+    lastBias = biasEnd;
+
+    const bool envelopeOn = sagStart > 0.0f || sagEnd > 0.0f || biasStart > 0.0f || biasEnd > 0.0f
+                         || modulation.isRouted (ModulationMatrix::targetSag) || modulation.isRouted (ModulationMatrix::targetBias);
+    if (envelopeOn) {
+        if (! envelopeWasOn)
+            envelope.reset();
+
+        const float* sag = getModulatedRamp (ModulationMatrix::targetSag, sagStart, sagEnd, 1.0f, 0.0f, 1.0f, numSamples);
+        const float* bias = getModulatedRamp (ModulationMatrix::targetBias, biasStart, biasEnd, 1.0f, 0.0f, 1.0f, numSamples);
+        for (int channel = 0; channel < numInputChannels; ++channel)
+            envelope.process (channel, buffer.getWritePointer (channel), numSamples, sag, bias);
+    }
+    envelopeWasOn = envelopeOn;
+
+    //======================================
+
+    const NeuralAmpModel* model = neuralModel.acquire();
+    shaperContext.neuralModel = model;
+    oversampledContext.neuralModel = model;
+
+    const TransferCurve* curve = transferCurve.acquire();
+    shaperContext.transferCurve = curve;
+    oversampledContext.transferCurve = curve;
+
+    const ShaperExpression* expression = shaperExpression.acquire();
+    shaperContext.expression = expression;
+    oversampledContext.expression = expression;
+
+    if (oversample) {
+        dsp::AudioBlock<float> block = dsp::AudioBlock<float> (buffer).getSubsetChannelBlock (0, (size_t)numInputChannels);
+        dsp::AudioBlock<float> oversampledBlock = oversampler->processSamplesUp (block);
+
+        for (int channel = 0; channel < numInputChannels; ++channel)
+            oversampledChannels[channel] = oversampledBlock.getChannelPointer ((size_t)channel);
+
+        processFeedbackLoop (oversampledChannels, numInputChannels, (int)oversampledBlock.getNumSamples(),
+                             oversampledContext, getSampleRate() * 2.0);
+        oversampler->processSamplesDown (block);
+    }
+    else {
+        processFeedbackLoop (buffer.getArrayOfWritePointers(), numInputChannels, numSamples, shaperContext, getSampleRate());
+    }
+
     //======================================
 
+    //requantising after the shapers gives the bit crusher its bit depth, with proper dither when asked for
+    const int quantizeMode = (int)paramQuantize.getTargetValue();
+    const bool ditherOn = quantizeMode != quantizeOff;
+    if (ditherOn) {
+        if (! ditherWasOn)
+            dither.reset();
+
+        dither.process (buffer.getArrayOfWritePointers(), numSamples, roundToInt (paramQuantizeBits.getTargetValue()),
+                        quantizeMode != quantizePlain, quantizeMode == quantizeShapedDither);
+    }
+    ditherWasOn = ditherOn;
+
+    const float* toneOffsets = modulation.isRouted (ModulationMatrix::targetTone)
+        ? getModulatedRamp (ModulationMatrix::targetTone, 0.0f, 0.0f, toneModulationRange, -toneModulationRange, toneModulationRange, numSamples)
+        : nullptr;
+    toneStage.processPost (*tone, buffer.getArrayOfWritePointers(), numSamples, toneOffsets);
+
+    PartitionedConvolver* cabinet = convolver.acquire();
+    const bool cabinetOn = paramCabinet.getTargetValue() > 0.5f
+                        && cabinet != nullptr && cabinet->getNumChannels() == numInputChannels;
+    if (cabinetOn) {
+        if (! cabinetWasOn)
+            cabinet->reset();
+
+        cabinet->process (buffer.getArrayOfWritePointers(), numSamples);
+    }
+    cabinetWasOn = cabinetOn;
+
     for (int channel = 0; channel < numInputChannels; ++channel) {
         float* channelData = buffer.getWritePointer (channel);
 
-        float out;
-        
-        //bitcrusher params
-        auto undFac = 4; //user param
-        auto cpt = 0; //constant
-        //slew limiter params
-        auto rise = 0.5f; //user param
-        auto fall = 0.5f; //user param
-        auto slewMin = 0.1f; //constant -max slope in volts per sec
-        auto slewMax = 10000.f; //constant -max slope in volts per sec
-        auto Ts = 1.f / 48000.f; //replace with actual sample rate
-        auto slewRise = slewMax * Ts * powf(slewMin / slewMax, rise);
-        auto slewFall = slewMax * Ts * powf(slewMin / slewMax, fall);
-        //ring modulator params
-//        auto twoPi = 2.f * M_PI;
-    
-        
-        for (int sample = 0; sample < numSamples; ++sample) {
-            const float in = channelData[sample] * paramInputGain.getNextValue();
-            
-            switch ((int)paramDistortionType.getTargetValue()) {
-                    
-                //hard clipping
-                case distortionTypeHardClipping: {
-                    float threshold = 0.5f;
-                    if (in > threshold)
-                        out = threshold;
-                    else if (in < -threshold)
-                        out = -threshold;
-                    else
-                        out = in;
-                    out *= 0.5f;
-                    break;
-                }
-                    
-                //soft clipping
-                case distortionTypeSoftClipping: {
-                    float threshold1 = 1.0f / 3.0f;
-                    float threshold2 = 2.0f / 3.0f;
-                    if (in > threshold2)
-                        out = 1.0f;
-                    else if (in > threshold1)
-                        out = 1.0f - powf (2.0f - 3.0f * in, 2.0f) / 3.0f;
-                    else if (in < -threshold2)
-                        out = -1.0f;
-                    else if (in < -threshold1)
-                        out = -1.0f + powf (2.0f + 3.0f * in, 2.0f) / 3.0f;
-                    else
-                        out = 2.0f * in;
-                    out *= 0.5f;
-                    break;
-                }
-                    
-                //exponential
-                case distortionTypeExponential: {
-                    if (in > 0.0f)
-                        out = 1.0f - expf (-in);
-                    else
-                        out = -1.0f + expf (in);
-                    out *= 0.05f;
-                    break;
-                }
-                
-                //full-wave rectifier
-                case distortionTypeFullWaveRectifier: {
-                    out = fabsf (in);
-                    break;
-                }
-                    
-                //half-wave rectifier
-                case distortionTypeHalfWaveRectifier: {
-                    if (in > 0.0f)
-                        out = in;
-                    else
-                        out = 0.0f;
-                    break;
-                }
-                 
-                //fold-back
-                case distortionTypeFoldBack: {
-                    float fblevel1 = 0.3f;
-                    float fblevel2 = fblevel1 * 2.0f;
-                    if (in > fblevel1)
-                        out = (fblevel2 - out) * 0.05f;
-                    else if (in < (-fblevel1)) {
-                        out = (-fblevel2 - out) * 0.05f;
-                    }
-                    break;
-                }
-   
-                //squarer
-                case distortionTypeSquarer: {
-                    out = powf(in, 2.0f);
-                    break;
-                }
-                    
-                //chebyshev 4th order
-                case distortionTypeChebT4: {
-                    out = (8.0f * powf(in, 4.0f)) - (8.0f * powf(in, 2.0f)) - 1.0f;
-                    out = out * 0.1f;
-                    break;
-                }
-                    
-                //bit crusher
-                case distortionTypeBitCrusher: {
-                    if (cpt == 0.0f)
-                        out = in;
-                    else
-                        out = 0.0f;
-                    cpt = (cpt + 1) % undFac;
-                    break;
-                }
-                    
-                //slew limiter
-                case distortionTypeSlewLimiter: {
-                    if (in > out)
-                        out = jmin (in, out + slewRise);
-                    else
-                        out = jmax (in, out - slewFall);
-                    break;
-                }
-            }
-
-            float filtered = filters[channel]->processSingleSampleRaw (out);
-            channelData[sample] = filtered * paramOutputGain.getNextValue();
-        }
+        if (autoGainOn)
+            autoGain.process (channel, channelData, numSamples);
+
+        if (needsDry)
+            mixWithDry (channelData, dryBuffer.getReadPointer (channel), mix, numSamples);
+
+        buffer.applyGainRamp (channel, 0, numSamples, outputGainStart, outputGainEnd);
     }
 
     //======================================
 
     for (int channel = numInputChannels; channel < numOutputChannels; ++channel)
         buffer.clear (channel, 0, numSamples);
+
+    const bool limiterOn = paramLimiter.getTargetValue() > 0.5f;
+    if (limiterOn) {
+        if (! limiterWasOn)
+            limiter.reset();
+
+        limiter.process (buffer.getArrayOfWritePointers(), numSamples, paramLimiterCeiling.getTargetValue());
+    }
+    limiterWasOn = limiterOn;
     
-    meterSource.measureBlock (buffer);
+    meterSource.measureBlock (getBusBuffer (buffer, false, 0));
+
+}
+
+//==============================================================================
+
+float* DistortionAudioProcessor::getModulatedRamp (int target, float start, float end, float scale,
+                                                   float minimum, float maximum, int numSamples) noexcept
+{
+    float* ramp = modulationBuffers.getWritePointer (target);
+    fillRamp (ramp, start, end, numSamples);
+    modulation.addTo (target, ramp, scale, numSamples);
+    FloatVectorOperations::clip (ramp, ramp, minimum, maximum, numSamples);
+    return ramp;
+}
+
+//==============================================================================
+
+void DistortionAudioProcessor::processFeedbackLoop (float* const* channelData, int numChannels, int numSamples,
+                                                    const ShaperContext& context, double sampleRate)
+{
+    const float amount = paramFeedback.getTargetValue();
+    const bool feedbackOn = amount > 0.0f;
+    //samples recorded at the other oversampling rate would play back at the wrong pitch
+    if ((feedbackOn && ! feedbackWasOn) || sampleRate != feedbackSampleRate)
+        feedback.reset();
+    feedbackWasOn = feedbackOn;
+    feedbackSampleRate = sampleRate;
+
+    const float delayStart = lastFeedbackDelay;
+    const float delayEnd = paramFeedbackDelay.getTargetValue();
+    lastFeedbackDelay = delayEnd;
+
+    //once per block, the chunks below all run with the same setups
+    shaperChain.acquire();
+    multibandSetup.acquire();
+    midSideSetup.acquire();
+
+    if (! feedbackOn) {
+        processShapers (channelData, numChannels, numSamples, context, true);
+        return;
+    }
+
+    //damping moves the lowpass in the loop from 20 kHz down to 200 Hz
+    const double cutoff = jmin (20000.0 * pow (0.01, (double)paramFeedbackDamping.getTargetValue()), sampleRate * 0.45);
+    const float damping = (float)(1.0 - exp (-MathConstants<double>::twoPi * cutoff / sampleRate));
+    const float dcTracking = (float)(1.0 - exp (-MathConstants<double>::twoPi * 20.0 / sampleRate));
+    const float samplesPerMillisecond = (float)(sampleRate * 0.001);
+
+    for (int start = 0; start < numSamples;) {
+        const float delayMs = delayStart + (delayEnd - delayStart) * (float)start / (float)numSamples;
+        const float delay = jlimit (2.0f, (float)feedback.getMaxDelay(), delayMs * samplesPerMillisecond);
+        const int num = jmin (FeedbackLoop::getChunkSize (delay), numSamples - start);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            feedbackChannels[channel] = channelData[channel] + start;
+
+        feedback.addFeedback (feedbackChannels, num, delay, amount, damping, dcTracking);
+        //a chunk is too short to be worth handing to the workers
+        processShapers (feedbackChannels, numChannels, num, context, false);
+        feedback.capture (feedbackChannels, num);
+
+        start += num;
+    }
+}
+
+//==============================================================================
+
+void DistortionAudioProcessor::processShapers (float* const* channelData, int numChannels, int numSamples,
+                                               const ShaperContext& context, bool allowParallel)
+{
+    const ShaperChain* chain = shaperChain.get();
+    const MultibandShaper::Setup* bands = multibandSetup.get();
+    const MidSideShaper::Setup* stereo = midSideSetup.get();
+
+    if (spectralMode != spectralOff) {
+        spectral.process (*chain, spectralMode == spectralMagnitudePhase, channelData, numSamples, context);
+        midSideWasOn = false;
+        multibandWasOn = false;
+        return;
+    }
+
+    const bool midSideOn = stereo->enabled && numChannels == 2;
+    if (midSideOn && ! midSideWasOn)
+        midSide.reset();
+    midSideWasOn = midSideOn;
+
+    if (midSideOn) {
+        midSide.process (*stereo, channelData[0], channelData[1], numSamples, context);
+        multibandWasOn = false;
+        return;
+    }
 
+    //the band states are stale once another path has been playing
+    const bool multibandOn = bands->getNumBands() > 1 && bands->crossover.numChannels == numChannels;
+    if (multibandOn && ! multibandWasOn)
+        multiband.reset();
+    multibandWasOn = multibandOn;
+
+    if (multibandOn) {
+        multiband.process (*bands, channelData, numSamples, context);
+        return;
+    }
+
+    ShaperJob job { chain, &context, shaperStates, shaperScratch.getArrayOfWritePointers(), shaperScratch.getNumSamples(),
+                    channelData, numSamples };
+
+    //the join is inside run(), so everything is done before the post filters and the meter;
+    //while the message thread starts or stops the pool the block runs serially
+    const SpinLock::ScopedTryLockType poolLock (channelPoolLock);
+    if (allowParallel && paramParallelChannels.getTargetValue() > 0.5f && poolLock.isLocked() && channelPool.getNumWorkers() > 0 && numChannels > 1)
+        channelPool.run (numChannels, processShaperChannel, &job);
+    else
+        for (int channel = 0; channel < numChannels; ++channel)
+            processShaperChannel (&job, channel, 0);
+}
+
+void DistortionAudioProcessor::processShaperChannel (void* job, int channel, int worker)
+{
+    const ShaperJob& j = *static_cast<const ShaperJob*> (job);
+
+    j.chain->process (j.channelData[channel], j.numSamples, j.states + channel * ShaperChain::maxStages,
+                      *j.context, j.scratch[2 * worker], j.scratch[2 * worker + 1], j.scratchSize);
+}
+
+int DistortionAudioProcessor::getWetPathLatency (bool oversample) const
+{
+    int latency = 0;
+
+    if (oversample)
+        latency += oversamplerLatency;
+
+    //one frame, counted at the rate the shapers run at
+    if ((int)paramSpectral.getTargetValue() != spectralOff)
+        latency += SpectralShaper::getFftSize ((int)paramFftSize.getTargetValue()) / (oversample ? 2 : 1);
+
+    return latency;
+}
+
+int DistortionAudioProcessor::getReportedLatency (bool oversample) const
+{
+    //the limiter delays everything, dry included, so it is not part of the wet path
+    int latency = getWetPathLatency (oversample);
+
+    if (paramLimiter.getTargetValue() > 0.5f)
+        latency += limiter.getLatency();
+
+    return latency;
+}
+
+//==============================================================================
+
+ShaperKernel DistortionAudioProcessor::getShaperKernel (int distortionType) const
+{
+    const bool useTables = (int)paramDiodeSolver.getTargetValue() == solverTable;
+    const bool useRK4 = (int)paramTapeSolver.getTargetValue() == tapeSolverRK4;
+
+    switch (distortionType) {
+        case distortionTypeHardClipping:        return ShaperKernels::hardClipping;
+        case distortionTypeSoftClipping:        return ShaperKernels::softClipping;
+        case distortionTypeExponential:         return ShaperKernels::exponential;
+        case distortionTypeFullWaveRectifier:   return ShaperKernels::fullWaveRectifier;
+        case distortionTypeHalfWaveRectifier:   return ShaperKernels::halfWaveRectifier;
+        case distortionTypeFoldBack:            return ShaperKernels::foldBack;
+        case distortionTypeSquarer:             return ShaperKernels::squarer;
+        case distortionTypeChebT4:              return ShaperKernels::chebyshevT4;
+        case distortionTypeBitCrusher:          return ShaperKernels::bitCrusher;
+        case distortionTypeSlewLimiter:         return ShaperKernels::slewLimiter;
+        case distortionTypeDiodeClipper:        return useTables ? ShaperKernels::diodeClipperTable
+                                                                 : ShaperKernels::diodeClipper;
+        case distortionTypeTriodeStage:         return ShaperKernels::triodeStage;
+        case distortionTypeTape:                return useRK4 ? ShaperKernels::tapeRK4
+                                                              : ShaperKernels::tapeRK2;
+        case distortionTypeNeuralAmp:           return ShaperKernels::neuralAmp;
+        case distortionTypeCustomCurve:         return ShaperKernels::customCurve;
+        case distortionTypeExpression:          return ShaperKernels::expression;
+        case distortionTypeOctaveDown:          return ShaperKernels::octaveDown;
+        default:                                break;
+    }
+
+    jassertfalse;
+    return ShaperKernels::hardClipping;
+}
+
+//the types with an asymmetric curve, the drawn, typed and trained ones can be anything
+bool DistortionAudioProcessor::makesDcOffset (int distortionType)
+{
+    switch (distortionType) {
+        case distortionTypeFullWaveRectifier:
+        case distortionTypeHalfWaveRectifier:
+        case distortionTypeSquarer:
+        case distortionTypeChebT4:
+        case distortionTypeNeuralAmp:
+        case distortionTypeCustomCurve:
+        case distortionTypeExpression:
+            return true;
+        default:
+            return false;
+    }
+}
+
+//bias makes every type asymmetric, otherwise the same choice of path as processShapers()
+bool DistortionAudioProcessor::needsDcBlocker() const
+{
+    if (paramBias.getTargetValue() > 0.0f
+        || (int)paramLfo1Target.getTargetValue() == ModulationMatrix::targetBias
+        || (int)paramLfo2Target.getTargetValue() == ModulationMatrix::targetBias)
+        return true;
+
+    const PluginParameter* stageTypes[ShaperChain::maxStages] = {
+        &paramDistortionType, &paramStage2Type, &paramStage3Type, &paramStage4Type
+    };
+    const PluginParameter* bandTypes[MultibandShaper::maxBands] = {
+        &paramBand1Type, &paramBand2Type, &paramBand3Type, &paramBand4Type
+    };
+
+    const bool spectralOn = (int)paramSpectral.getTargetValue() != spectralOff;
+    const int numBands = (int)paramBands.getTargetValue() + 1;
+
+    if (! spectralOn && (int)paramStereoMode.getTargetValue() == stereoModeMidSide && getMainBusNumInputChannels() == 2)
+        return makesDcOffset ((int)paramMidType.getTargetValue()) || makesDcOffset ((int)paramSideType.getTargetValue());
+
+    const bool multibandOn = ! spectralOn && numBands > 1;
+    const PluginParameter* const* types = multibandOn ? bandTypes : stageTypes;
+    const int numTypes = multibandOn ? numBands
+                                     : jlimit (1, (int)ShaperChain::maxStages, (int)paramChainStages.getTargetValue() + 1);
+
+    for (int i = 0; i < numTypes; ++i)
+        if (makesDcOffset ((int)types[i]->getTargetValue()))
+            return true;
+
+    return false;
+}
+
+//==============================================================================
+
+void DistortionAudioProcessor::updateShaperChain()
+{
+    const PluginParameter* types[ShaperChain::maxStages] = {
+        &paramDistortionType, &paramStage2Type, &paramStage3Type, &paramStage4Type
+    };
+    const PluginParameter* gains[ShaperChain::maxStages] = {
+        &paramStage1Gain, &paramStage2Gain, &paramStage3Gain, &paramStage4Gain
+    };
+
+    std::unique_ptr<ShaperChain> chain (new ShaperChain());
+    chain->numStages = jlimit (1, (int)ShaperChain::maxStages, (int)paramChainStages.getTargetValue() + 1);
+    chain->parallel = (int)paramChainMode.getTargetValue() == chainModeParallel;
+
+    for (int stage = 0; stage < chain->numStages; ++stage) {
+        chain->stages[stage].kernel = getShaperKernel ((int)types[stage]->getTargetValue());
+        chain->stages[stage].gain = Decibels::decibelsToGain (gains[stage]->getTargetValue());
+    }
+
+    shaperChain.publish (std::move (chain));
+}
+
+void DistortionAudioProcessor::updateMultiband()
+{
+    const PluginParameter* types[MultibandShaper::maxBands] = {
+        &paramBand1Type, &paramBand2Type, &paramBand3Type, &paramBand4Type
+    };
+    const PluginParameter* drives[MultibandShaper::maxBands] = {
+        &paramBand1Drive, &paramBand2Drive, &paramBand3Drive, &paramBand4Drive
+    };
+
+    const int numBands = (int)paramBands.getTargetValue() + 1;
+    const bool oversample = (int)paramOversampling.getTargetValue() == oversampling2x;
+    const double sampleRate = (getSampleRate() > 0.0 ? getSampleRate() : 44100.0) * (oversample ? 2.0 : 1.0);
+
+    //2 bands split at mid, 3 bands at low and high, 4 bands at all three
+    double cutoffs[MultibandShaper::maxBands - 1] = {
+        paramCrossoverLow.getTargetValue(), paramCrossoverMid.getTargetValue(), paramCrossoverHigh.getTargetValue()
+    };
+    std::sort (cutoffs, cutoffs + 3);
+    if (numBands == 2)
+        cutoffs[0] = cutoffs[1];
+    else if (numBands == 3)
+        cutoffs[1] = cutoffs[2];
+
+    std::unique_ptr<MultibandShaper::Setup> setup (new MultibandShaper::Setup());
+    setup->crossover.build (numBands, cutoffs, sampleRate, getMainBusNumInputChannels());
+
+    for (int band = 0; band < MultibandShaper::maxBands; ++band) {
+        setup->bands[band].kernel = getShaperKernel ((int)types[band]->getTargetValue());
+        setup->bands[band].drive = Decibels::decibelsToGain (drives[band]->getTargetValue());
+    }
+
+    multibandSetup.publish (std::move (setup));
+}
+
+void DistortionAudioProcessor::updateMidSide()
+{
+    std::unique_ptr<MidSideShaper::Setup> setup (new MidSideShaper::Setup());
+    setup->enabled = (int)paramStereoMode.getTargetValue() == stereoModeMidSide;
+    setup->midKernel = getShaperKernel ((int)paramMidType.getTargetValue());
+    setup->sideKernel = getShaperKernel ((int)paramSideType.getTargetValue());
+    setup->midDrive = Decibels::decibelsToGain (paramMidDrive.getTargetValue());
+    setup->sideDrive = Decibels::decibelsToGain (paramSideDrive.getTargetValue());
+
+    midSideSetup.publish (std::move (setup));
+}
+
+void DistortionAudioProcessor::updateChannelPool()
+{
+    const int numWorkers = paramParallelChannels.getTargetValue() > 0.5f ? channelPoolSize : 0;
+    if (numWorkers == channelPool.getNumWorkers())
+        return;
+
+    const SpinLock::ScopedLockType lock (channelPoolLock);
+    if (numWorkers > 0)
+        channelPool.start (numWorkers);
+    else
+        channelPool.stop();
+}
+
+void DistortionAudioProcessor::handleAsyncUpdate()
+{
+    updateShaperChain();
+    updateMultiband();
+    updateMidSide();
+    updateChannelPool();
+    updateFilters();
+
+    const int latency = getReportedLatency ((int)paramOversampling.getTargetValue() == oversampling2x);
+    if (latency != getLatencySamples())
+        setLatencySamples (latency);
+}
+
+//==============================================================================
+
+void DistortionAudioProcessor::loadNeuralModel (const File& file)
+{
+    parameters.apvts.state.setProperty ("neuralModel", file.getFullPathName(), nullptr);
+
+    loaderPool.addJob ([this, file]
+    {
+        String error;
+        std::unique_ptr<NeuralAmpModel> model (NeuralAmpModel::loadFromJson (file, error));
+
+        if (model != nullptr)
+            neuralModel.publish (std::move (model));
+        else
+            DBG ("Could not load " + file.getFullPathName() + ": " + error);
+    });
+}
+
+String DistortionAudioProcessor::getNeuralModelPath() const
+{
+    return parameters.apvts.state.getProperty ("neuralModel").toString();
+}
+
+void DistortionAudioProcessor::loadImpulseResponse (const File& file)
+{
+    parameters.apvts.state.setProperty ("impulseResponse", file.getFullPathName(), nullptr);
+
+    loaderPool.addJob ([this, file]
+    {
+        AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+
+        //wav and aiff are mapped into memory, other formats fall back to a streaming reader
+        std::unique_ptr<AudioFormatReader> reader;
+        if (AudioFormat* format = formatManager.findFormatForFileExtension (file.getFileExtension())) {
+            std::unique_ptr<MemoryMappedAudioFormatReader> mapped (format->createMemoryMappedReader (file));
+            if (mapped != nullptr && mapped->mapEntireFile())
+                reader = std::move (mapped);
+        }
+        if (reader == nullptr)
+            reader.reset (formatManager.createReaderFor (file));
+
+        if (reader == nullptr) {
+            DBG ("Could not load " + file.getFullPathName());
+            return;
+        }
+
+        const int numSamples = (int)jmin (reader->lengthInSamples, (int64)(maxImpulseSeconds * reader->sampleRate));
+        AudioSampleBuffer loaded ((int)jmin (reader->numChannels, 2u), numSamples);
+        reader->read (&loaded, 0, numSamples, 0, true, true);
+
+        {
+            const ScopedLock sl (impulseLock);
+            impulse = std::move (loaded);
+            impulseSampleRate = reader->sampleRate;
+        }
+
+        updateConvolver();
+    });
+}
+
+String DistortionAudioProcessor::getImpulseResponsePath() const
+{
+    return parameters.apvts.state.getProperty ("impulseResponse").toString();
+}
+
+void DistortionAudioProcessor::updateConvolver()
+{
+    const ScopedLock sl (impulseLock);
+    if (impulse.getNumSamples() == 0)
+        return;
+
+    //resample to the processing rate and scale to unit energy, so cabinets of any loudness sit at the same level
+    const double sampleRate = getSampleRate() > 0.0 ? getSampleRate() : 44100.0;
+    const double ratio = impulseSampleRate / sampleRate;
+    const int numSamples = jmax (1, (int)(impulse.getNumSamples() / ratio));
+    AudioSampleBuffer resampled (impulse.getNumChannels(), numSamples);
+
+    for (int channel = 0; channel < impulse.getNumChannels(); ++channel) {
+        LagrangeInterpolator interpolator;
+        resampled.clear (channel, 0, numSamples);
+        interpolator.process (ratio, impulse.getReadPointer (channel), resampled.getWritePointer (channel),
+                              numSamples, impulse.getNumSamples(), 0);
+
+        const float* data = resampled.getReadPointer (channel);
+        double energy = 0.0;
+        for (int i = 0; i < numSamples; ++i)
+            energy += (double)data[i] * data[i];
+        if (energy > 0.0)
+            resampled.applyGain (channel, 0, numSamples, (float)(1.0 / std::sqrt (energy)));
+    }
+
+    convolver.publish (std::unique_ptr<PartitionedConvolver> (new PartitionedConvolver (resampled, getMainBusNumInputChannels())));
+}
+
+void DistortionAudioProcessor::setTransferCurve (const TransferCurve::Points& points, bool storeInState)
+{
+    if (storeInState)
+        parameters.apvts.state.setProperty ("transferCurve", TransferCurve::toString (points), nullptr);
+
+    {
+        const ScopedLock lock (curveLock);
+        pendingCurve = points;
+    }
+
+    //a job that is still queued builds the latest points, so there is never more than one
+    if (curveJobQueued.exchange (true))
+        return;
+
+    loaderPool.addJob ([this]
+    {
+        //cleared before the points are read, anything newer queues the next job
+        curveJobQueued.store (false);
+
+        TransferCurve::Points latest;
+        {
+            const ScopedLock lock (curveLock);
+            latest = pendingCurve;
+        }
+
+        transferCurve.publish (std::unique_ptr<TransferCurve> (new TransferCurve (latest)));
+    });
+}
+
+TransferCurve::Points DistortionAudioProcessor::getTransferCurvePoints() const
+{
+    return TransferCurve::fromString (parameters.apvts.state.getProperty ("transferCurve").toString());
+}
+
+String DistortionAudioProcessor::setShaperExpression (const String& text)
+{
+    parameters.apvts.state.setProperty ("expression", text, nullptr);
+
+    String error;
+    std::unique_ptr<ShaperExpression> expression (ShaperExpression::compile (text, error));
+
+    //a formula that does not compile keeps the previous one playing
+    if (expression != nullptr)
+        shaperExpression.publish (std::move (expression));
+
+    return error;
+}
+
+String DistortionAudioProcessor::getShaperExpressionText() const
+{
+    return parameters.apvts.state.getProperty ("expression", "tanh(3*x) - 0.1*x^3").toString();
 }
 
 //==============================================================================
@@ -240,11 +1033,13 @@ void DistortionAudioProcessor::processBlock (AudioSampleBuffer& buffer, MidiBuff
 void DistortionAudioProcessor::updateFilters()
 {
     double discreteFrequency = M_PI * 0.01;
-    //10^paramToneValue * 0.05
-    double gain = pow (10.0, (double)paramTone.getTargetValue() * 0.05);
+    const double sampleRate = getSampleRate() > 0.0 ? getSampleRate() : 44100.0;
+
+    std::unique_ptr<ToneStage::Setup> setup (new ToneStage::Setup());
+    setup->build (getMainBusNumInputChannels(), sampleRate, discreteFrequency, paramTone.getTargetValue(),
+                  paramEmphasisFrequency.getTargetValue(), paramEmphasis.getTargetValue(), needsDcBlocker());
 
-    for (int i = 0; i < filters.size(); ++i)
-        filters[i]->updateCoefficients (discreteFrequency, gain);
+    toneSetup.publish (std::move (setup));
 }
 
 //==============================================================================
@@ -268,8 +1063,20 @@ void DistortionAudioProcessor::setStateInformation (const void* data, int sizeIn
     std::unique_ptr<XmlElement> xmlState (getXmlFromBinary (data, sizeInBytes));
 
     if (xmlState.get() != nullptr)
-        if (xmlState->hasTagName (parameters.apvts.state.getType()))
+        if (xmlState->hasTagName (parameters.apvts.state.getType())) {
             parameters.apvts.replaceState (ValueTree::fromXml (*xmlState));
+
+            const String modelPath = getNeuralModelPath();
+            if (modelPath.isNotEmpty())
+                loadNeuralModel (File (modelPath));
+
+            const String impulsePath = getImpulseResponsePath();
+            if (impulsePath.isNotEmpty())
+                loadImpulseResponse (File (impulsePath));
+
+            setTransferCurve (getTransferCurvePoints());
+            setShaperExpression (getShaperExpressionText());
+        }
 }
 
 //==============================================================================
@@ -293,16 +1100,30 @@ bool DistortionAudioProcessor::isBusesLayoutSupported (const BusesLayout& layout
     ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    if (layouts.getMainOutputChannelSet() != AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != AudioChannelSet::stereo())
+    // Mono, stereo, 5.1, 7.1.4 and 1st to 3rd order ambisonics (up to 16 channels)
+    const AudioChannelSet mainSet = layouts.getMainOutputChannelSet();
+    if (mainSet != AudioChannelSet::mono()
+     && mainSet != AudioChannelSet::stereo()
+     && mainSet != AudioChannelSet::create5point1()
+     && mainSet != AudioChannelSet::create7point1point4()
+     && mainSet != AudioChannelSet::ambisonic (1)
+     && mainSet != AudioChannelSet::ambisonic (2)
+     && mainSet != AudioChannelSet::ambisonic (3))
         return false;
 
     // This checks if the input layout matches the output layout
    #if ! JucePlugin_IsSynth
     if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
         return false;
+
+    // The sidechain is optional, mono or stereo
+    if (layouts.inputBuses.size() > 1) {
+        const AudioChannelSet sidechainSet = layouts.getChannelSet (true, 1);
+        if (! sidechainSet.isDisabled()
+         && sidechainSet != AudioChannelSet::mono()
+         && sidechainSet != AudioChannelSet::stereo())
+            return false;
+    }
    #endif
 
     return true;
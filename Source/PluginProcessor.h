@@ -32,11 +32,28 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "PluginParameter.h"
+#include "RealtimeObjectSwap.h"
+#include "ShaperKernels.h"
+#include "MultibandShaper.h"
+#include "DelayLine.h"
+#include "AutoGain.h"
+#include "SpectralShaper.h"
+#include "EnvelopeFollower.h"
+#include "ToneStage.h"
+#include "SidechainFollower.h"
+#include "MidSideShaper.h"
+#include "ChannelWorkerPool.h"
+#include "LookaheadLimiter.h"
+#include "PartitionedConvolver.h"
+#include "ModulationMatrix.h"
+#include "FeedbackLoop.h"
+#include "DitherStage.h"
 
 
 //==============================================================================
 
-class DistortionAudioProcessor : public AudioProcessor
+class DistortionAudioProcessor : public AudioProcessor,
+                                  private AsyncUpdater
 {
 public:
     //==============================================================================
@@ -110,7 +127,14 @@ public:
         "Squarer",
         "Chebyshev 4th order",
         "Bit crusher",
-        "Slew Limiter"
+        "Slew Limiter",
+        "Diode clipper",
+        "Triode stage",
+        "Tape",
+        "Neural amp",
+        "Custom curve",
+        "Expression",
+        "Octave down"
     };
 
     enum distortionTypeIndex {
@@ -124,33 +148,191 @@ public:
         distortionTypeChebT4,
         distortionTypeBitCrusher,
         distortionTypeSlewLimiter,
+        distortionTypeDiodeClipper,
+        distortionTypeTriodeStage,
+        distortionTypeTape,
+        distortionTypeNeuralAmp,
+        distortionTypeCustomCurve,
+        distortionTypeExpression,
+        distortionTypeOctaveDown,
     };
 
-    //======================================
+    StringArray chainStagesItemsUI = {
+        "1",
+        "2",
+        "3",
+        "4"
+    };
 
-    class Filter : public IIRFilter 
-    {
-    public:
-        void updateCoefficients (const double discreteFrequency,
-                                 const double gain) noexcept
-        {
-            jassert (discreteFrequency > 0);
+    StringArray chainModeItemsUI = {
+        "Serial",
+        "Parallel"
+    };
 
-            double tan_half_wc = tan (discreteFrequency / 2.0); //wc = cutoff freq
-            double sqrt_gain = sqrt (gain);
+    enum chainModeIndex {
+        chainModeSerial = 0,
+        chainModeParallel,
+    };
 
-            coefficients = IIRCoefficients (/* b0 */ sqrt_gain * tan_half_wc + gain,
-                                            /* b1 */ sqrt_gain * tan_half_wc - gain,
-                                            /* b2 */ 0.0,
-                                            /* a0 */ sqrt_gain * tan_half_wc + 1.0,
-                                            /* a1 */ sqrt_gain * tan_half_wc - 1.0,
-                                            /* a2 */ 0.0);
+    StringArray bandsItemsUI = {
+        "1",
+        "2",
+        "3",
+        "4"
+    };
 
-            setCoefficients (coefficients);
-        }
+    StringArray solverItemsUI = {
+        "Newton-Raphson",
+        "Table"
     };
 
-    OwnedArray<Filter> filters;
+    enum solverIndex {
+        solverNewtonRaphson = 0,
+        solverTable,
+    };
+
+    StringArray tapeSolverItemsUI = {
+        "RK2",
+        "RK4"
+    };
+
+    enum tapeSolverIndex {
+        tapeSolverRK2 = 0,
+        tapeSolverRK4,
+    };
+
+    StringArray oversamplingItemsUI = {
+        "Off",
+        "2x"
+    };
+
+    enum oversamplingIndex {
+        oversamplingOff = 0,
+        oversampling2x,
+    };
+
+    StringArray spectralItemsUI = {
+        "Off",
+        "Magnitude",
+        "Magnitude + phase"
+    };
+
+    enum spectralIndex {
+        spectralOff = 0,
+        spectralMagnitude,
+        spectralMagnitudePhase,
+    };
+
+    StringArray fftSizeItemsUI = {
+        "512",
+        "1024",
+        "2048"
+    };
+
+    StringArray sidechainItemsUI = {
+        "Off",
+        "Input gain",
+        "Mix"
+    };
+
+    enum sidechainIndex {
+        sidechainOff = 0,
+        sidechainInputGain,
+        sidechainMix,
+    };
+
+    StringArray stereoModeItemsUI = {
+        "Left/right",
+        "Mid/side"
+    };
+
+    enum stereoModeIndex {
+        stereoModeLeftRight = 0,
+        stereoModeMidSide,
+    };
+
+    StringArray quantizeItemsUI = {
+        "Off",
+        "Plain",
+        "TPDF dither",
+        "Shaped dither"
+    };
+
+    enum quantizeIndex {
+        quantizeOff = 0,
+        quantizePlain,
+        quantizeDither,
+        quantizeShapedDither,
+    };
+
+    //in the order of ModulationMatrix::Shape and ModulationMatrix::Target
+    StringArray lfoShapeItemsUI = {
+        "Sine",
+        "Triangle",
+        "Sample & hold"
+    };
+
+    StringArray lfoTargetItemsUI = {
+        "Off",
+        "Input gain",
+        "Tone",
+        "Mix",
+        "Sag",
+        "Bias"
+    };
+
+    StringArray lfoSyncItemsUI = {
+        "Off",
+        "1/1",
+        "1/2",
+        "1/4",
+        "1/8",
+        "1/16"
+    };
+
+    ShaperKernel getShaperKernel (int distortionType) const;
+    static bool makesDcOffset (int distortionType);
+    bool needsDcBlocker() const;
+    int getWetPathLatency (bool oversample) const;
+    int getReportedLatency (bool oversample) const;
+    void updateShaperChain();
+    void updateMultiband();
+    void updateMidSide();
+
+    /** The workers only exist while "Parallel channels" is on. */
+    void updateChannelPool();
+
+    /** Parses the model on a background thread and swaps it in when it is ready,
+        the file is remembered in the plugin state.
+    */
+    void loadNeuralModel (const File& file);
+    String getNeuralModelPath() const;
+
+    /** Compiles the drawn curve on a background thread and swaps it in. Calls that
+        come faster than the rebuilds are coalesced, only the latest points are built.
+        storeInState is false for the intermediate curves of a drag.
+    */
+    void setTransferCurve (const TransferCurve::Points& points, bool storeInState = true);
+    TransferCurve::Points getTransferCurvePoints() const;
+
+    /** Reads the impulse response on a background thread and swaps in a new
+        convolver when it is ready, the file is remembered in the plugin state.
+    */
+    void loadImpulseResponse (const File& file);
+    String getImpulseResponsePath() const;
+
+    /** Resamples and partitions the loaded response for the current rate and layout,
+        called on the loader thread.
+    */
+    void updateConvolver();
+
+    /** Compiles the formula and swaps it in, returns the error if it does not compile. */
+    String setShaperExpression (const String& text);
+    String getShaperExpressionText() const;
+
+    //======================================
+
+    /** Rebuilds the tone and emphasis filters and swaps them in. */
     void updateFilters();
 
     //======================================
@@ -162,7 +344,187 @@ public:
     PluginParameterLinSlider paramOutputGain;
     PluginParameterLinSlider paramTone;
 
+    PluginParameterComboBox paramChainStages;
+    PluginParameterComboBox paramChainMode;
+    PluginParameterComboBox paramStage2Type;
+    PluginParameterComboBox paramStage3Type;
+    PluginParameterComboBox paramStage4Type;
+    PluginParameterLinSlider paramStage1Gain;
+    PluginParameterLinSlider paramStage2Gain;
+    PluginParameterLinSlider paramStage3Gain;
+    PluginParameterLinSlider paramStage4Gain;
+
+    PluginParameterComboBox paramBands;
+    PluginParameterLogSlider paramCrossoverLow;
+    PluginParameterLogSlider paramCrossoverMid;
+    PluginParameterLogSlider paramCrossoverHigh;
+    PluginParameterComboBox paramBand1Type;
+    PluginParameterComboBox paramBand2Type;
+    PluginParameterComboBox paramBand3Type;
+    PluginParameterComboBox paramBand4Type;
+    PluginParameterLinSlider paramBand1Drive;
+    PluginParameterLinSlider paramBand2Drive;
+    PluginParameterLinSlider paramBand3Drive;
+    PluginParameterLinSlider paramBand4Drive;
+
+    PluginParameterLinSlider paramMix;
+    PluginParameterToggle paramAutoGain;
+    PluginParameterComboBox paramDiodeSolver;
+    PluginParameterComboBox paramOversampling;
+    PluginParameterComboBox paramTapeSolver;
+    PluginParameterComboBox paramSpectral;
+    PluginParameterComboBox paramFftSize;
+    PluginParameterLinSlider paramSag;
+    PluginParameterLinSlider paramBias;
+    PluginParameterLinSlider paramEmphasis;
+    PluginParameterLogSlider paramEmphasisFrequency;
+    PluginParameterComboBox paramSidechain;
+    PluginParameterLinSlider paramSidechainDepth;
+    PluginParameterComboBox paramStereoMode;
+    PluginParameterComboBox paramMidType;
+    PluginParameterComboBox paramSideType;
+    PluginParameterLinSlider paramMidDrive;
+    PluginParameterLinSlider paramSideDrive;
+    PluginParameterToggle paramParallelChannels;
+    PluginParameterToggle paramLimiter;
+    PluginParameterLinSlider paramLimiterCeiling;
+    PluginParameterToggle paramCabinet;
+    PluginParameterComboBox paramLfo1Shape;
+    PluginParameterLogSlider paramLfo1Rate;
+    PluginParameterComboBox paramLfo1Sync;
+    PluginParameterComboBox paramLfo1Target;
+    PluginParameterLinSlider paramLfo1Depth;
+    PluginParameterComboBox paramLfo2Shape;
+    PluginParameterLogSlider paramLfo2Rate;
+    PluginParameterComboBox paramLfo2Sync;
+    PluginParameterComboBox paramLfo2Target;
+    PluginParameterLinSlider paramLfo2Depth;
+    PluginParameterLinSlider paramFeedback;
+    PluginParameterLogSlider paramFeedbackDelay;
+    PluginParameterLinSlider paramFeedbackDamping;
+    PluginParameterComboBox paramQuantize;
+    PluginParameterLinSlider paramQuantizeBits;
+
 private:
+    //==============================================================================
+
+    void handleAsyncUpdate() override;
+    /** processBlock() for at most preparedBlockSize samples. */
+    void processChunk (AudioSampleBuffer& buffer);
+    /** Runs on the setups processFeedbackLoop() acquired for the block. */
+    void processShapers (float* const* channelData, int numChannels, int numSamples, const ShaperContext& context,
+                         bool allowParallel);
+    /** processShapers() inside the feedback loop, in chunks that fit under the delay and on the audio thread. */
+    void processFeedbackLoop (float* const* channelData, int numChannels, int numSamples,
+                              const ShaperContext& context, double sampleRate);
+
+    /** The per sample ramp of one parameter with the LFOs routed to it added, clipped to its range. */
+    float* getModulatedRamp (int target, float start, float end, float scale,
+                             float minimum, float maximum, int numSamples) noexcept;
+
+    /** One channel of the serial/parallel chain, as a task for channelPool. */
+    struct ShaperJob
+    {
+        const ShaperChain* chain;
+        const ShaperContext* context;
+        ShaperState* states;
+        float* const* scratch;
+        int scratchSize;
+        float* const* channelData;
+        int numSamples;
+    };
+    static void processShaperChannel (void* job, int channel, int worker);
+
+    RealtimeObjectSwap<ShaperChain> shaperChain;
+    ShaperContext shaperContext;
+    ShaperContext oversampledContext;
+    HeapBlock<ShaperState> shaperStates;  // numChannels * ShaperChain::maxStages
+    AudioSampleBuffer shaperScratch;  // 2 channels per worker, the audio thread last
+
+    RealtimeObjectSwap<ToneStage::Setup> toneSetup;
+    ToneStage toneStage;
+
+    RealtimeObjectSwap<MultibandShaper::Setup> multibandSetup;
+    MultibandShaper multiband;
+    bool multibandWasOn = false;
+
+    RealtimeObjectSwap<MidSideShaper::Setup> midSideSetup;
+    MidSideShaper midSide;
+    bool midSideWasOn = false;
+
+    ChannelWorkerPool channelPool;
+    SpinLock channelPoolLock;  // held by the message thread around start() and stop()
+    int channelPoolSize = 0;   // workers to start when it is on
+
+    std::unique_ptr<dsp::Oversampling<float>> oversampler;
+    HeapBlock<float*> oversampledChannels;
+    int oversamplerLatency = 0;
+    bool wasOversampling = false;
+
+    SpectralShaper spectral;
+    int spectralMode = spectralOff;
+
+    int preparedBlockSize = 1;  // processBlock() splits longer host blocks
+
+    //latency of the wet path, the dry path is delayed by the same amount
+    int wetLatency = 0;
+    DelayLine dryDelay;
+    AudioSampleBuffer dryBuffer;  // preparedBlockSize samples
+    float lastMix = 1.0f;
+
+    AutoGain autoGain;
+    bool autoGainWasOn = false;
+
+    EnvelopeFollower envelope;
+    bool envelopeWasOn = false;
+    float lastSag = 0.0f;
+    float lastBias = 0.0f;
+
+    //full depth on the input gain moves it by this much
+    const float sidechainGainRange = 24.0f;  // dB
+    RealtimeObjectSwap<PartitionedConvolver> convolver;
+    bool cabinetWasOn = false;
+
+    //the impulse response as loaded, resampled and rebuilt when the sample rate or layout changes
+    CriticalSection impulseLock;
+    AudioSampleBuffer impulse;
+    double impulseSampleRate = 0.0;
+    const double maxImpulseSeconds = 8.0;
+
+    LookaheadLimiter limiter;
+    bool limiterWasOn = false;
+
+    SidechainFollower sidechain;
+    HeapBlock<float> sidechainLevels;   // one per sub-block
+    AudioSampleBuffer sidechainCurves;  // input gain and mix factor per sample
+    float lastSidechainGain = 1.0f;
+    float lastSidechainMix = 1.0f;
+
+    FeedbackLoop feedback;
+    HeapBlock<float*> feedbackChannels;
+    bool feedbackWasOn = false;
+    double feedbackSampleRate = 0.0;  // the rate the loop last ran at, 2x when oversampling
+    float lastFeedbackDelay = 0.0f;
+    //the loop runs at the oversampled rate, the buffer is sized for the longest delay at the highest one
+    const double maxFeedbackSampleRate = 192000.0 * 2.0;
+    const double maxFeedbackDelay = 0.05;  // seconds, the top of paramFeedbackDelay
+
+    DitherStage dither;
+    bool ditherWasOn = false;
+
+    ModulationMatrix modulation;
+    AudioSampleBuffer modulationBuffers;  // one per ModulationMatrix::Target, the ramps with the LFOs added
+    //full depth on the tone moves it by this much
+    const float toneModulationRange = 24.0f;  // dB
+
+    RealtimeObjectSwap<NeuralAmpModel> neuralModel;
+    RealtimeObjectSwap<TransferCurve> transferCurve;
+    CriticalSection curveLock;
+    TransferCurve::Points pendingCurve;
+    std::atomic<bool> curveJobQueued { false };
+    RealtimeObjectSwap<ShaperExpression> shaperExpression;
+    ThreadPool loaderPool { 1 };
+
     foleys::LevelMeterSource meterSource;
 
     //==============================================================================
@@ -0,0 +1,94 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** Hands objects that were built off the audio thread over to the audio thread
+    without locks, and takes the old ones back so they are never deleted there.
+
+    publish() and collectGarbage() may be called from any non-realtime thread,
+    acquire() and get() only from the audio thread.
+*/
+template <typename ObjectType>
+class RealtimeObjectSwap
+{
+public:
+    RealtimeObjectSwap() = default;
+
+    ~RealtimeObjectSwap()
+    {
+        delete current;
+        delete pending.load();
+        delete retired.load();
+    }
+
+    //==============================================================================
+
+    void publish (std::unique_ptr<ObjectType> newObject)
+    {
+        const ScopedLock sl (publishLock);
+        collectGarbage();
+
+        // if the audio thread never picked up the previous object it is still ours to delete
+        delete pending.exchange (newObject.release());
+    }
+
+    void collectGarbage()
+    {
+        delete retired.exchange (nullptr);
+    }
+
+    //==============================================================================
+
+    ObjectType* acquire() noexcept
+    {
+        // only swap when the previous object has been collected, so retired never overflows
+        if (retired.load() == nullptr) {
+            if (ObjectType* next = pending.exchange (nullptr)) {
+                retired.store (current);
+                current = next;
+            }
+        }
+
+        return current;
+    }
+
+    ObjectType* get() const noexcept
+    {
+        return current;
+    }
+
+private:
+    //==============================================================================
+
+    ObjectType* current = nullptr;
+    std::atomic<ObjectType*> pending { nullptr };
+    std::atomic<ObjectType*> retired { nullptr };
+
+    CriticalSection publishLock;
+
+    JUCE_DECLARE_NON_COPYABLE (RealtimeObjectSwap)
+};
+
+//==============================================================================
@@ -0,0 +1,473 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** A shaper typed in as a formula of x, e.g. "tanh(3*x) - 0.1*x^3".
+
+    The text is parsed into a list of nodes that folds constants and shares
+    identical subexpressions as it is built, then compiled to a register based
+    bytecode. Each instruction works on a whole chunk of samples at once, so the
+    dispatch is paid once per chunk and instruction instead of once per sample.
+
+    Operators: + - * / ^ and unary minus. Constants: pi, e. Functions: abs, sqrt,
+    exp, log, sin, cos, tan, tanh, atan, floor, sign, and min, max, pow with two
+    arguments.
+*/
+class ShaperExpression
+{
+public:
+    enum {
+        maxRegisters = 16,
+        chunkSize = 64,
+    };
+
+    /** Returns nullptr and fills error if the text does not compile. */
+    static std::unique_ptr<ShaperExpression> compile (const String& text, String& error)
+    {
+        std::unique_ptr<ShaperExpression> expression (new ShaperExpression());
+        Compiler compiler (text.toRawUTF8(), *expression);
+
+        if (! compiler.run (error))
+            return nullptr;
+
+        return expression;
+    }
+
+    int getNumInstructions() const noexcept { return instructions.size(); }
+
+    //==============================================================================
+
+    void process (float* data, int numSamples) const noexcept
+    {
+        alignas (32) float registerData[maxRegisters - 1][chunkSize];
+        float* registers[maxRegisters];
+
+        for (int start = 0; start < numSamples; start += chunkSize) {
+            const int n = jmin ((int)chunkSize, numSamples - start);
+
+            //register 0 is the input itself
+            registers[0] = data + start;
+            for (int i = 1; i < maxRegisters; ++i)
+                registers[i] = registerData[i - 1];
+
+            for (const Instruction& instruction : instructions)
+                execute (instruction, registers, n);
+
+            //a division by zero or a log of a negative number must not reach the filters
+            float* out = data + start;
+            const float* result = registers[outputRegister];
+            for (int i = 0; i < n; ++i)
+                out[i] = std::isfinite (result[i]) ? jlimit (-16.0f, 16.0f, result[i]) : 0.0f;
+        }
+    }
+
+private:
+    //==============================================================================
+
+    enum class Op
+    {
+        input, constant, load,
+        negate, add, subtract, multiply, divide, power, minimum, maximum,
+        addScalar, multiplyScalar,
+        abs, sqrt, exp, log, sin, cos, tan, tanh, atan, floor, sign,
+    };
+
+    struct Instruction
+    {
+        Op op;
+        int dest;
+        int a;
+        int b;
+        float value;
+    };
+
+    Array<Instruction> instructions;
+    int outputRegister = 0;
+
+    ShaperExpression() = default;
+
+    //==============================================================================
+
+    static float evaluate (Op op, float a, float b) noexcept
+    {
+        switch (op) {
+            case Op::negate:    return -a;
+            case Op::add:       return a + b;
+            case Op::subtract:  return a - b;
+            case Op::multiply:  return a * b;
+            case Op::divide:    return a / b;
+            case Op::power:     return std::pow (a, b);
+            case Op::minimum:   return jmin (a, b);
+            case Op::maximum:   return jmax (a, b);
+            case Op::abs:       return std::abs (a);
+            case Op::sqrt:      return std::sqrt (a);
+            case Op::exp:       return std::exp (a);
+            case Op::log:       return std::log (a);
+            case Op::sin:       return std::sin (a);
+            case Op::cos:       return std::cos (a);
+            case Op::tan:       return std::tan (a);
+            case Op::tanh:      return std::tanh (a);
+            case Op::atan:      return std::atan (a);
+            case Op::floor:     return std::floor (a);
+            case Op::sign:      return (float)((a > 0.0f) - (a < 0.0f));
+            default:            break;
+        }
+
+        jassertfalse;
+        return 0.0f;
+    }
+
+    static void execute (const Instruction& instruction, float* const* registers, int n) noexcept
+    {
+        float* d = registers[instruction.dest];
+        const float* a = instruction.a >= 0 ? registers[instruction.a] : nullptr;
+        const float* b = instruction.b >= 0 ? registers[instruction.b] : nullptr;
+
+        switch (instruction.op) {
+            case Op::load:              FloatVectorOperations::fill (d, instruction.value, n); return;
+            case Op::negate:            FloatVectorOperations::negate (d, a, n); return;
+            case Op::add:               FloatVectorOperations::add (d, a, b, n); return;
+            case Op::subtract:          FloatVectorOperations::subtract (d, a, b, n); return;
+            case Op::multiply:          FloatVectorOperations::multiply (d, a, b, n); return;
+            case Op::minimum:           FloatVectorOperations::min (d, a, b, n); return;
+            case Op::maximum:           FloatVectorOperations::max (d, a, b, n); return;
+            case Op::addScalar:         FloatVectorOperations::add (d, a, instruction.value, n); return;
+            case Op::multiplyScalar:    FloatVectorOperations::multiply (d, a, instruction.value, n); return;
+            case Op::abs:               FloatVectorOperations::abs (d, a, n); return;
+            default:                    break;
+        }
+
+        //the rest get one tight loop each, the switch is not inside them
+        switch (instruction.op) {
+            case Op::divide:    for (int i = 0; i < n; ++i) d[i] = a[i] / b[i]; break;
+            case Op::power:     for (int i = 0; i < n; ++i) d[i] = std::pow (a[i], b[i]); break;
+            case Op::sqrt:      for (int i = 0; i < n; ++i) d[i] = std::sqrt (a[i]); break;
+            case Op::exp:       for (int i = 0; i < n; ++i) d[i] = std::exp (a[i]); break;
+            case Op::log:       for (int i = 0; i < n; ++i) d[i] = std::log (a[i]); break;
+            case Op::sin:       for (int i = 0; i < n; ++i) d[i] = std::sin (a[i]); break;
+            case Op::cos:       for (int i = 0; i < n; ++i) d[i] = std::cos (a[i]); break;
+            case Op::tan:       for (int i = 0; i < n; ++i) d[i] = std::tan (a[i]); break;
+            case Op::tanh:      for (int i = 0; i < n; ++i) d[i] = std::tanh (a[i]); break;
+            case Op::atan:      for (int i = 0; i < n; ++i) d[i] = std::atan (a[i]); break;
+            case Op::floor:     for (int i = 0; i < n; ++i) d[i] = std::floor (a[i]); break;
+            case Op::sign:      for (int i = 0; i < n; ++i) d[i] = (float)((a[i] > 0.0f) - (a[i] < 0.0f)); break;
+            default:            jassertfalse; break;
+        }
+    }
+
+    //==============================================================================
+
+    /** Recursive descent parser building a folded, deduplicated node list,
+        followed by register allocation and code generation.
+    */
+    class Compiler
+    {
+    public:
+        Compiler (const char* textToParse, ShaperExpression& target)
+            : text (textToParse), expression (target)
+        {
+        }
+
+        bool run (String& errorMessage)
+        {
+            const int root = parseSum();
+            skipSpaces();
+
+            if (error.isEmpty() && *text != 0)
+                error = "Unexpected '" + String::charToString ((juce_wchar)*text) + "'";
+
+            if (error.isEmpty())
+                generate (root);
+
+            errorMessage = error;
+            return error.isEmpty();
+        }
+
+    private:
+        struct Node
+        {
+            Op op;
+            int a;
+            int b;
+            float value;
+        };
+
+        const char* text;
+        ShaperExpression& expression;
+        Array<Node> nodes;
+        String error;
+
+        //==============================================================================
+
+        int addNode (Op op, int a = -1, int b = -1, float value = 0.0f)
+        {
+            if (a < 0 && op != Op::input && op != Op::constant)
+                return -1;  // an operand already failed to parse
+
+            //constant folding
+            const bool foldA = a >= 0 && nodes[a].op == Op::constant;
+            const bool foldB = b < 0 || nodes[b].op == Op::constant;
+            if (foldA && foldB) {
+                value = evaluate (op, nodes[a].value, b >= 0 ? nodes[b].value : 0.0f);
+                op = Op::constant;
+                a = b = -1;
+            }
+
+            //commutative operations get one operand order, so x*y and y*x are shared
+            if ((op == Op::add || op == Op::multiply || op == Op::minimum || op == Op::maximum) && a > b)
+                std::swap (a, b);
+
+            //common subexpressions
+            for (int i = 0; i < nodes.size(); ++i) {
+                const Node& node = nodes.getReference (i);
+                if (node.op == op && node.a == a && node.b == b && (op != Op::constant || node.value == value))
+                    return i;
+            }
+
+            nodes.add ({ op, a, b, value });
+            return nodes.size() - 1;
+        }
+
+        //==============================================================================
+
+        void skipSpaces()
+        {
+            while (*text == ' ' || *text == '\t')
+                ++text;
+        }
+
+        bool match (char c)
+        {
+            skipSpaces();
+            if (*text != c)
+                return false;
+            ++text;
+            return true;
+        }
+
+        void expect (char c)
+        {
+            if (! match (c) && error.isEmpty())
+                error = "Expected '" + String::charToString ((juce_wchar)c) + "'";
+        }
+
+        int parseSum()
+        {
+            int left = parseProduct();
+            while (error.isEmpty()) {
+                if (match ('+'))
+                    left = addNode (Op::add, left, parseProduct());
+                else if (match ('-'))
+                    left = addNode (Op::subtract, left, parseProduct());
+                else
+                    break;
+            }
+            return left;
+        }
+
+        int parseProduct()
+        {
+            int left = parseUnary();
+            while (error.isEmpty()) {
+                if (match ('*'))
+                    left = addNode (Op::multiply, left, parseUnary());
+                else if (match ('/'))
+                    left = addNode (Op::divide, left, parseUnary());
+                else
+                    break;
+            }
+            return left;
+        }
+
+        int parseUnary()
+        {
+            if (match ('-'))
+                return addNode (Op::negate, parseUnary());
+            if (match ('+'))
+                return parseUnary();
+            return parsePower();
+        }
+
+        int parsePower()
+        {
+            const int base = parsePrimary();
+            if (! match ('^'))
+                return base;
+
+            //right associative, small integer powers become multiplications
+            const int exponent = parseUnary();
+            if (exponent >= 0 && nodes[exponent].op == Op::constant) {
+                if (nodes[exponent].value == 2.0f)
+                    return addNode (Op::multiply, base, base);
+                if (nodes[exponent].value == 3.0f)
+                    return addNode (Op::multiply, addNode (Op::multiply, base, base), base);
+            }
+            return addNode (Op::power, base, exponent);
+        }
+
+        int parsePrimary()
+        {
+            skipSpaces();
+
+            if (match ('(')) {
+                const int inner = parseSum();
+                expect (')');
+                return inner;
+            }
+
+            if (CharacterFunctions::isDigit ((juce_wchar)*text) || *text == '.') {
+                //not strtod, which would follow the decimal point of the host's locale
+                CharPointer_ASCII number (text);
+                const float value = (float)CharacterFunctions::readDoubleValue (number);
+                text = number.getAddress();
+                return addNode (Op::constant, -1, -1, value);
+            }
+
+            String name;
+            while (CharacterFunctions::isLetter ((juce_wchar)*text))
+                name += String::charToString ((juce_wchar)*text++);
+
+            if (name == "x")    return addNode (Op::input);
+            if (name == "pi")   return addNode (Op::constant, -1, -1, MathConstants<float>::pi);
+            if (name == "e")    return addNode (Op::constant, -1, -1, MathConstants<float>::euler);
+
+            static const struct { const char* name; Op op; int numArguments; } functions[] = {
+                { "abs", Op::abs, 1 },   { "sqrt", Op::sqrt, 1 }, { "exp", Op::exp, 1 },
+                { "log", Op::log, 1 },   { "sin", Op::sin, 1 },   { "cos", Op::cos, 1 },
+                { "tan", Op::tan, 1 },   { "tanh", Op::tanh, 1 }, { "atan", Op::atan, 1 },
+                { "floor", Op::floor, 1 }, { "sign", Op::sign, 1 },
+                { "min", Op::minimum, 2 }, { "max", Op::maximum, 2 }, { "pow", Op::power, 2 },
+            };
+
+            for (const auto& function : functions) {
+                if (name != function.name)
+                    continue;
+
+                expect ('(');
+                const int a = parseSum();
+                int b = -1;
+                if (function.numArguments == 2) {
+                    expect (',');
+                    b = parseSum();
+                }
+                expect (')');
+                return addNode (function.op, a, b);
+            }
+
+            if (error.isEmpty())
+                error = name.isEmpty() ? String ("Expected a value") : "Unknown name '" + name + "'";
+            return -1;
+        }
+
+        //==============================================================================
+
+        void generate (int root)
+        {
+            //only nodes reachable from the root survive folding, each is freed after its last use
+            Array<int> lastUse;
+            lastUse.insertMultiple (0, -1, nodes.size());
+            lastUse.set (root, nodes.size());
+            for (int i = root; i >= 0; --i) {
+                if (lastUse[i] < 0)
+                    continue;
+                const Node& node = nodes.getReference (i);
+                if (node.a >= 0 && lastUse[node.a] < 0) lastUse.set (node.a, i);
+                if (node.b >= 0 && lastUse[node.b] < 0) lastUse.set (node.b, i);
+            }
+
+            Array<int> nodeRegister;
+            nodeRegister.insertMultiple (0, -1, nodes.size());
+            bool used[maxRegisters] = { true };     // register 0 is the input
+
+            auto allocate = [&]() -> int
+            {
+                for (int r = 1; r < maxRegisters; ++r)
+                    if (! used[r]) {
+                        used[r] = true;
+                        return r;
+                    }
+                error = "Expression needs too many registers";
+                return 0;
+            };
+
+            //constants only get a register when an instruction cannot take them as a scalar
+            auto getRegister = [&](int index) -> int
+            {
+                if (nodeRegister[index] < 0) {
+                    const int r = allocate();
+                    expression.instructions.add ({ Op::load, r, -1, -1, nodes[index].value });
+                    nodeRegister.set (index, r);
+                }
+                return nodeRegister[index];
+            };
+
+            for (int i = 0; i <= root && error.isEmpty(); ++i) {
+                const Node node = nodes[i];
+                if (lastUse[i] < 0 || node.op == Op::constant)
+                    continue;
+                if (node.op == Op::input) {
+                    nodeRegister.set (i, 0);
+                    continue;
+                }
+
+                Instruction instruction { node.op, 0, -1, -1, 0.0f };
+                const bool constantA = nodes[node.a].op == Op::constant;
+                const bool constantB = node.b >= 0 && nodes[node.b].op == Op::constant;
+
+                if ((node.op == Op::add || node.op == Op::multiply) && (constantA || constantB)) {
+                    instruction.op = node.op == Op::add ? Op::addScalar : Op::multiplyScalar;
+                    instruction.a = getRegister (constantA ? node.b : node.a);
+                    instruction.value = nodes[constantA ? node.a : node.b].value;
+                }
+                else if ((node.op == Op::subtract || node.op == Op::divide) && constantB) {
+                    instruction.op = node.op == Op::subtract ? Op::addScalar : Op::multiplyScalar;
+                    instruction.a = getRegister (node.a);
+                    instruction.value = node.op == Op::subtract ? -nodes[node.b].value : 1.0f / nodes[node.b].value;
+                }
+                else {
+                    instruction.a = getRegister (node.a);
+                    if (node.b >= 0)
+                        instruction.b = getRegister (node.b);
+                }
+
+                //operands die before the result is allocated, elementwise ops may run in place
+                for (int operand : { node.a, node.b })
+                    if (operand >= 0 && lastUse[operand] == i && nodeRegister[operand] > 0)
+                        used[nodeRegister[operand]] = false;
+
+                instruction.dest = allocate();
+                nodeRegister.set (i, instruction.dest);
+                expression.instructions.add (instruction);
+            }
+
+            if (error.isEmpty())
+                expression.outputRegister = getRegister (root);
+        }
+    };
+
+    JUCE_DECLARE_NON_COPYABLE (ShaperExpression)
+};
+
+//==============================================================================
@@ -0,0 +1,406 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "DiodeClipper.h"
+#include "TriodeStage.h"
+#include "TapeHysteresis.h"
+#include "NeuralAmpModel.h"
+#include "TransferCurve.h"
+#include "ShaperExpression.h"
+
+//==============================================================================
+
+/** Per channel, per stage memory of the stateful shapers. */
+struct ShaperState
+{
+    float last = 0.0f;          // previous output (fold-back, slew limiter, diode clipper)
+    int counter = 0;            // decimation phase (bit crusher), flip-flop (octave down)
+    float previousInput = 0.0f; // diode clipper, tape, octave down
+    float history = 0.0f;       // folded trapezoidal history (diode clipper)
+    float capacitors[TriodeModel::numStates] = {};  // triode stage
+    float magnetisation = 0.0f; // tape
+    uint32 neuralSerial = 0;    // model the recurrent state below belongs to (neural amp)
+    float hidden[NeuralAmpModel::maxHiddenSize] = {};
+    float cell[NeuralAmpModel::maxHiddenSize] = {};
+};
+
+/** Constants that depend on the sample rate, computed in prepareToPlay. */
+struct ShaperContext
+{
+    //bitcrusher params
+    int crushFactor = 4;
+    //slew limiter params
+    float slewRise = 0.0f;
+    float slewFall = 0.0f;
+    //diode clipper
+    DiodeClipperModel diode;
+    //triode stage
+    TriodeModel triode;
+    //tape
+    TapeHysteresisModel tape;
+    //neural amp, acquired by the audio thread at the start of every block
+    const NeuralAmpModel* neuralModel = nullptr;
+    //custom curve, acquired the same way
+    const TransferCurve* transferCurve = nullptr;
+    //typed in formula, acquired the same way
+    const ShaperExpression* expression = nullptr;
+
+    void prepare (double sampleRate)
+    {
+        diode.prepare (sampleRate);
+        triode.prepare (sampleRate);
+        tape.prepare (sampleRate);
+
+        const float rise = 0.5f;
+        const float fall = 0.5f;
+        const float slewMin = 0.1f;     // max slope in volts per sec
+        const float slewMax = 10000.f;  // max slope in volts per sec
+        const float Ts = 1.0f / (float)sampleRate;
+
+        slewRise = slewMax * Ts * powf (slewMin / slewMax, rise);
+        slewFall = slewMax * Ts * powf (slewMin / slewMax, fall);
+    }
+};
+
+/** A shaper processes a whole block in place. */
+typedef void (*ShaperKernel) (float* data, int numSamples, ShaperState& state, const ShaperContext& context);
+
+//==============================================================================
+
+/** Block versions of the distortion types. The stateless ones are written without
+    branches so the compiler can vectorise them, the others keep their recursion.
+*/
+namespace ShaperKernels
+{
+    inline void hardClipping (float* data, int numSamples, ShaperState&, const ShaperContext&)
+    {
+        const float threshold = 0.5f;
+        FloatVectorOperations::clip (data, data, -threshold, threshold, numSamples);
+        FloatVectorOperations::multiply (data, 0.5f, numSamples);
+    }
+
+    inline void softClipping (float* data, int numSamples, ShaperState&, const ShaperContext&)
+    {
+        const float threshold1 = 1.0f / 3.0f;
+        const float threshold2 = 2.0f / 3.0f;
+
+        for (int i = 0; i < numSamples; ++i) {
+            const float in = data[i];
+            const float x = std::abs (in);
+            const float knee = 2.0f - 3.0f * x;
+
+            float out = x > threshold2 ? 1.0f : 1.0f - knee * knee / 3.0f;
+            out = x > threshold1 ? out : 2.0f * x;
+            data[i] = std::copysign (out, in) * 0.5f;
+        }
+    }
+
+    inline void exponential (float* data, int numSamples, ShaperState&, const ShaperContext&)
+    {
+        for (int i = 0; i < numSamples; ++i) {
+            const float in = data[i];
+            data[i] = std::copysign (1.0f - expf (-std::abs (in)), in) * 0.05f;
+        }
+    }
+
+    inline void fullWaveRectifier (float* data, int numSamples, ShaperState&, const ShaperContext&)
+    {
+        FloatVectorOperations::abs (data, data, numSamples);
+    }
+
+    inline void halfWaveRectifier (float* data, int numSamples, ShaperState&, const ShaperContext&)
+    {
+        FloatVectorOperations::max (data, data, 0.0f, numSamples);
+    }
+
+    inline void foldBack (float* data, int numSamples, ShaperState& state, const ShaperContext&)
+    {
+        const float fblevel1 = 0.3f;
+        const float fblevel2 = fblevel1 * 2.0f;
+        float out = state.last;
+
+        for (int i = 0; i < numSamples; ++i) {
+            const float in = data[i];
+            if (in > fblevel1)
+                out = (fblevel2 - out) * 0.05f;
+            else if (in < -fblevel1)
+                out = (-fblevel2 - out) * 0.05f;
+            data[i] = out;
+        }
+
+        state.last = out;
+    }
+
+    inline void squarer (float* data, int numSamples, ShaperState&, const ShaperContext&)
+    {
+        FloatVectorOperations::multiply (data, data, data, numSamples);
+    }
+
+    inline void chebyshevT4 (float* data, int numSamples, ShaperState&, const ShaperContext&)
+    {
+        for (int i = 0; i < numSamples; ++i) {
+            const float x2 = data[i] * data[i];
+            data[i] = (8.0f * x2 * x2 - 8.0f * x2 - 1.0f) * 0.1f;
+        }
+    }
+
+    inline void bitCrusher (float* data, int numSamples, ShaperState& state, const ShaperContext& context)
+    {
+        // keeps one sample out of crushFactor, the phase carries over to the next block
+        int cpt = state.counter;
+
+        for (int i = 0; i < numSamples; ++i) {
+            if (cpt != 0)
+                data[i] = 0.0f;
+            cpt = (cpt + 1) % context.crushFactor;
+        }
+
+        state.counter = cpt;
+    }
+
+    inline void slewLimiter (float* data, int numSamples, ShaperState& state, const ShaperContext& context)
+    {
+        float out = state.last;
+
+        for (int i = 0; i < numSamples; ++i) {
+            const float in = data[i];
+            if (in > out)
+                out = jmin (in, out + context.slewRise);
+            else
+                out = jmax (in, out - context.slewFall);
+            data[i] = out;
+        }
+
+        state.last = out;
+    }
+
+    inline void diodeClipper (float* data, int numSamples, ShaperState& state, const ShaperContext& context)
+    {
+        const DiodeClipperModel& model = context.diode;
+        float v = state.last;
+        float q = state.history;
+        float previous = state.previousInput;
+        int iterations;
+
+        for (int i = 0; i < numSamples; ++i) {
+            const float in = data[i];
+            q = 2.0f * v - q + model.k * (previous + in);
+            previous = in;
+
+            v = model.solve (q, v, iterations);
+            data[i] = v;
+        }
+
+        state.last = v;
+        state.history = q;
+        state.previousInput = previous;
+    }
+
+    inline void diodeClipperTable (float* data, int numSamples, ShaperState& state, const ShaperContext& context)
+    {
+        const DiodeClipperModel& model = context.diode;
+        float v = state.last;
+        float q = state.history;
+        float previous = state.previousInput;
+
+        for (int i = 0; i < numSamples; ++i) {
+            const float in = data[i];
+            q = 2.0f * v - q + model.k * (previous + in);
+            previous = in;
+
+            v = model.lookup (q);
+            data[i] = v;
+        }
+
+        state.last = v;
+        state.history = q;
+        state.previousInput = previous;
+    }
+
+    inline void triodeStage (float* data, int numSamples, ShaperState& state, const ShaperContext& context)
+    {
+        const TriodeModel& model = context.triode;
+        float x[TriodeModel::numStates] = { state.capacitors[0], state.capacitors[1] };
+
+        for (int i = 0; i < numSamples; ++i)
+            data[i] = model.processSample (data[i], x);
+
+        state.capacitors[0] = x[0];
+        state.capacitors[1] = x[1];
+    }
+
+    inline void tapeRK2 (float* data, int numSamples, ShaperState& state, const ShaperContext& context)
+    {
+        const TapeHysteresisModel& model = context.tape;
+        float m = state.magnetisation;
+        float previous = state.previousInput;
+
+        for (int i = 0; i < numSamples; ++i) {
+            const float h = data[i];
+            m = model.processRK2 (h, previous, m);
+            previous = h;
+            data[i] = m;
+        }
+
+        state.magnetisation = m;
+        state.previousInput = previous;
+    }
+
+    inline void tapeRK4 (float* data, int numSamples, ShaperState& state, const ShaperContext& context)
+    {
+        const TapeHysteresisModel& model = context.tape;
+        float m = state.magnetisation;
+        float previous = state.previousInput;
+
+        for (int i = 0; i < numSamples; ++i) {
+            const float h = data[i];
+            m = model.processRK4 (h, previous, m);
+            previous = h;
+            data[i] = m;
+        }
+
+        state.magnetisation = m;
+        state.previousInput = previous;
+    }
+
+    inline void neuralAmp (float* data, int numSamples, ShaperState& state, const ShaperContext& context)
+    {
+        //passes the signal through until a model has been loaded
+        const NeuralAmpModel* model = context.neuralModel;
+        if (model == nullptr)
+            return;
+
+        if (state.neuralSerial != model->getSerial()) {
+            std::fill (state.hidden, state.hidden + NeuralAmpModel::maxHiddenSize, 0.0f);
+            std::fill (state.cell, state.cell + NeuralAmpModel::maxHiddenSize, 0.0f);
+            state.neuralSerial = model->getSerial();
+        }
+
+        for (int i = 0; i < numSamples; ++i)
+            data[i] = model->processSample (data[i], state.hidden, state.cell);
+    }
+
+    inline void customCurve (float* data, int numSamples, ShaperState&, const ShaperContext& context)
+    {
+        if (context.transferCurve != nullptr)
+            context.transferCurve->process (data, numSamples);
+    }
+
+    inline void expression (float* data, int numSamples, ShaperState&, const ShaperContext& context)
+    {
+        if (context.expression != nullptr)
+            context.expression->process (data, numSamples);
+    }
+
+    inline void octaveDown (float* data, int numSamples, ShaperState& state, const ShaperContext&)
+    {
+        // a flip-flop toggled by every rising zero crossing is a square wave one octave down,
+        // the input times that square keeps its envelope and is blended with the dry signal
+        const float blend = 0.5f;
+        const int chunkSize = 256;
+        alignas (32) int crossings[chunkSize];
+        alignas (32) float signs[chunkSize];
+        float previous = state.previousInput;
+        int flip = state.counter;
+
+        for (int start = 0; start < numSamples; start += chunkSize) {
+            const int num = jmin (chunkSize, numSamples - start);
+            float* block = data + start;
+
+            //no dependency between samples here
+            crossings[0] = previous < 0.0f && block[0] >= 0.0f;
+            for (int i = 1; i < num; ++i)
+                crossings[i] = block[i - 1] < 0.0f && block[i] >= 0.0f;
+
+            //the running parity of the crossings is the flip-flop, one xor per sample
+            for (int i = 0; i < num; ++i) {
+                flip ^= crossings[i];
+                signs[i] = (float)(1 - 2 * flip);
+            }
+
+            previous = block[num - 1];
+            for (int i = 0; i < num; ++i)
+                block[i] *= (1.0f - blend) + blend * signs[i];
+        }
+
+        state.previousInput = previous;
+        state.counter = flip;
+    }
+}
+
+//==============================================================================
+
+/** A flat, prebuilt list of shaper stages. It is built on the message thread and
+    handed to the audio thread as a whole, so processing walks an array of function
+    pointers once per block instead of switching on the type for every sample.
+*/
+struct ShaperChain
+{
+    enum {
+        maxStages = 4,
+    };
+
+    struct Stage
+    {
+        ShaperKernel kernel = nullptr;
+        float gain = 1.0f;
+    };
+
+    Stage stages[maxStages];
+    int numStages = 0;
+    bool parallel = false;
+
+    //==============================================================================
+
+    /** states must hold maxStages entries for the channel being processed,
+        input and work are scratch buffers of scratchSize samples.
+    */
+    void process (float* data, int numSamples, ShaperState* states, const ShaperContext& context,
+                  float* input, float* work, int scratchSize) const
+    {
+        if (! parallel) {
+            for (int stage = 0; stage < numStages; ++stage) {
+                stages[stage].kernel (data, numSamples, states[stage], context);
+                if (stages[stage].gain != 1.0f)
+                    FloatVectorOperations::multiply (data, stages[stage].gain, numSamples);
+            }
+            return;
+        }
+
+        for (int start = 0; start < numSamples; start += scratchSize) {
+            const int num = jmin (scratchSize, numSamples - start);
+            float* block = data + start;
+
+            FloatVectorOperations::copy (input, block, num);
+            FloatVectorOperations::clear (block, num);
+
+            for (int stage = 0; stage < numStages; ++stage) {
+                FloatVectorOperations::copy (work, input, num);
+                stages[stage].kernel (work, num, states[stage], context);
+                FloatVectorOperations::addWithMultiply (block, work, stages[stage].gain, num);
+            }
+        }
+    }
+};
+
+//==============================================================================
@@ -0,0 +1,92 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** Level of the sidechain input, updated every subBlockSize samples.
+
+    Each sub-block is reduced to its peak with one vectorised min/max pass per
+    channel, then the peaks are smoothed with separate attack and release times.
+    Sub-blocks are short enough for the attack time to hold, and the processor
+    ramps its gain linearly between them, so nothing runs per sample here.
+*/
+class SidechainFollower
+{
+public:
+    enum {
+        subBlockSize = 32,
+    };
+
+    static int getNumLevels (int numSamples) noexcept { return (numSamples + subBlockSize - 1) / subBlockSize; }
+
+    void prepare (double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        level = 0.0f;
+    }
+
+    /** Writes the smoothed peak, 0 to 1, at the end of each of the getNumLevels (numSamples) sub-blocks. */
+    void process (const float* const* channelData, int numChannels, int numSamples, float* levels) noexcept
+    {
+        for (int start = 0, index = 0; start < numSamples; start += subBlockSize, ++index) {
+            const int num = jmin ((int)subBlockSize, numSamples - start);
+
+            float peak = 0.0f;
+            for (int channel = 0; channel < numChannels; ++channel) {
+                const Range<float> range = FloatVectorOperations::findMinAndMax (channelData[channel] + start, num);
+                peak = jmax (peak, -range.getStart(), range.getEnd());
+            }
+            peak = jmin (peak, 1.0f);
+
+            const double time = peak > level ? attackTime : releaseTime;
+            level += (float)(1.0 - exp (-(double)num / (sampleRate * time))) * (peak - level);
+            levels[index] = level;
+        }
+    }
+
+    /** Maps the level to a 0 to 1 factor. Negative depths duck (a loud sidechain
+        lowers the factor), positive depths trigger (a quiet sidechain lowers it).
+    */
+    static float getFactor (float level, float depth) noexcept
+    {
+        return depth < 0.0f ? 1.0f + depth * level
+                            : 1.0f - depth * (1.0f - level);
+    }
+
+private:
+    //==============================================================================
+
+    const double attackTime = 0.005;    // seconds
+    const double releaseTime = 0.15;    // seconds
+
+    double sampleRate = 44100.0;
+    float level = 0.0f;
+};
+
+//==============================================================================
@@ -0,0 +1,203 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** Normalised biquad coefficients (a0 == 1), transposed direct form II. */
+struct BiquadCoefficients
+{
+    float b0 = 1.0f;
+    float b1 = 0.0f;
+    float b2 = 0.0f;
+    float a1 = 0.0f;
+    float a2 = 0.0f;
+
+    //==============================================================================
+
+    static BiquadCoefficients makeLowPass (double sampleRate, double frequency, double Q)
+    {
+        const double w0 = MathConstants<double>::twoPi * limitFrequency (sampleRate, frequency) / sampleRate;
+        const double cosw0 = cos (w0);
+        const double alpha = sin (w0) / (2.0 * Q);
+
+        return normalise ((1.0 - cosw0) * 0.5, 1.0 - cosw0, (1.0 - cosw0) * 0.5,
+                          1.0 + alpha, -2.0 * cosw0, 1.0 - alpha);
+    }
+
+    static BiquadCoefficients makeHighPass (double sampleRate, double frequency, double Q)
+    {
+        const double w0 = MathConstants<double>::twoPi * limitFrequency (sampleRate, frequency) / sampleRate;
+        const double cosw0 = cos (w0);
+        const double alpha = sin (w0) / (2.0 * Q);
+
+        return normalise ((1.0 + cosw0) * 0.5, -(1.0 + cosw0), (1.0 + cosw0) * 0.5,
+                          1.0 + alpha, -2.0 * cosw0, 1.0 - alpha);
+    }
+
+    static BiquadCoefficients makeAllPass (double sampleRate, double frequency, double Q)
+    {
+        const double w0 = MathConstants<double>::twoPi * limitFrequency (sampleRate, frequency) / sampleRate;
+        const double cosw0 = cos (w0);
+        const double alpha = sin (w0) / (2.0 * Q);
+
+        return normalise (1.0 - alpha, -2.0 * cosw0, 1.0 + alpha,
+                          1.0 + alpha, -2.0 * cosw0, 1.0 - alpha);
+    }
+
+    /** RBJ high shelf with a slope of 1. Shelves of +g and -g dB are exact inverses. */
+    static BiquadCoefficients makeHighShelf (double sampleRate, double frequency, double gainDecibels)
+    {
+        const double A = pow (10.0, gainDecibels / 40.0);
+        const double w0 = MathConstants<double>::twoPi * limitFrequency (sampleRate, frequency) / sampleRate;
+        const double cosw0 = cos (w0);
+        const double twoSqrtAAlpha = 2.0 * sqrt (A) * sin (w0) / MathConstants<double>::sqrt2;
+
+        return normalise (A * ((A + 1.0) + (A - 1.0) * cosw0 + twoSqrtAAlpha),
+                          -2.0 * A * ((A - 1.0) + (A + 1.0) * cosw0),
+                          A * ((A + 1.0) + (A - 1.0) * cosw0 - twoSqrtAAlpha),
+                          (A + 1.0) - (A - 1.0) * cosw0 + twoSqrtAAlpha,
+                          2.0 * ((A - 1.0) - (A + 1.0) * cosw0),
+                          (A + 1.0) - (A - 1.0) * cosw0 - twoSqrtAAlpha);
+    }
+
+    /** The first order shelf of the tone control, unity at DC and gain at Nyquist. */
+    static BiquadCoefficients makeFirstOrderShelf (double discreteFrequency, double gain)
+    {
+        const double tanHalfWc = tan (discreteFrequency / 2.0);
+        const double sqrtGain = sqrt (gain);
+
+        return normalise (sqrtGain * tanHalfWc + gain, sqrtGain * tanHalfWc - gain, 0.0,
+                          sqrtGain * tanHalfWc + 1.0, sqrtGain * tanHalfWc - 1.0, 0.0);
+    }
+
+    /** One pole, one zero highpass that removes DC, unity at Nyquist. */
+    static BiquadCoefficients makeDcBlocker (double sampleRate, double frequency)
+    {
+        const double R = exp (-MathConstants<double>::twoPi * limitFrequency (sampleRate, frequency) / sampleRate);
+        const double g = (1.0 + R) * 0.5;
+
+        return normalise (g, -g, 0.0, 1.0, -R, 0.0);
+    }
+
+    static BiquadCoefficients normalise (double b0, double b1, double b2,
+                                         double a0, double a1, double a2)
+    {
+        BiquadCoefficients c;
+        c.b0 = (float)(b0 / a0);
+        c.b1 = (float)(b1 / a0);
+        c.b2 = (float)(b2 / a0);
+        c.a1 = (float)(a1 / a0);
+        c.a2 = (float)(a2 / a0);
+        return c;
+    }
+
+    static double limitFrequency (double sampleRate, double frequency)
+    {
+        return jlimit (1.0, sampleRate * 0.45, frequency);
+    }
+};
+
+//==============================================================================
+
+/** Coefficients of many independent biquads stored as structure of arrays,
+    one entry per lane. Lanes are usually (filter, channel) pairs.
+*/
+struct SoABiquadCoefficients
+{
+    HeapBlock<float> b0, b1, b2, a1, a2;
+    int numLanes = 0;
+
+    void allocate (int lanes)
+    {
+        numLanes = lanes;
+        b0.malloc ((size_t)lanes);
+        b1.malloc ((size_t)lanes);
+        b2.malloc ((size_t)lanes);
+        a1.malloc ((size_t)lanes);
+        a2.malloc ((size_t)lanes);
+
+        for (int lane = 0; lane < lanes; ++lane)
+            set (lane, BiquadCoefficients());
+    }
+
+    void set (int lane, const BiquadCoefficients& c) noexcept
+    {
+        jassert (isPositiveAndBelow (lane, numLanes));
+        b0[lane] = c.b0;
+        b1[lane] = c.b1;
+        b2[lane] = c.b2;
+        a1[lane] = c.a1;
+        a2[lane] = c.a2;
+    }
+};
+
+/** The matching filter memory, owned by whoever runs the filters. */
+struct SoABiquadState
+{
+    HeapBlock<float> z1, z2;
+    int numLanes = 0;
+
+    void allocate (int lanes)
+    {
+        numLanes = lanes;
+        z1.calloc ((size_t)lanes);
+        z2.calloc ((size_t)lanes);
+    }
+
+    void reset() noexcept
+    {
+        if (numLanes > 0) {
+            z1.clear ((size_t)numLanes);
+            z2.clear ((size_t)numLanes);
+        }
+    }
+};
+
+//==============================================================================
+
+/** Runs one sample of every lane in place. There is no dependency between lanes,
+    so the loop is vectorised across them.
+*/
+forcedinline void processSoABiquad (const SoABiquadCoefficients& c, SoABiquadState& s,
+                                    float* data, int firstLane, int numLanes) noexcept
+{
+    const float* JUCE_RESTRICT b0 = c.b0 + firstLane;
+    const float* JUCE_RESTRICT b1 = c.b1 + firstLane;
+    const float* JUCE_RESTRICT b2 = c.b2 + firstLane;
+    const float* JUCE_RESTRICT a1 = c.a1 + firstLane;
+    const float* JUCE_RESTRICT a2 = c.a2 + firstLane;
+    float* JUCE_RESTRICT z1 = s.z1 + firstLane;
+    float* JUCE_RESTRICT z2 = s.z2 + firstLane;
+    float* JUCE_RESTRICT x = data + firstLane;
+
+    for (int i = 0; i < numLanes; ++i) {
+        const float in = x[i];
+        const float out = b0[i] * in + z1[i];
+        z1[i] = b1[i] * in - a1[i] * out + z2[i];
+        z2[i] = b2[i] * in - a2[i] * out;
+        x[i] = out;
+    }
+}
+
+//==============================================================================
@@ -0,0 +1,228 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "ShaperKernels.h"
+
+//==============================================================================
+
+/** Runs the shaper chain on the spectrum instead of the waveform.
+
+    Frames of fftSize samples are Hann windowed every fftSize / 4 samples, the
+    bin magnitudes (scaled so a full scale sine peaks at 1) and optionally the
+    phases (scaled to -1..1) go through the chain, and the result is windowed
+    again and overlap-added. A quarter frame hop is the largest one for which the
+    squared Hann window still sums to a constant, so it is the cheapest hop that
+    does not modulate the output. The latency is one full frame.
+
+    All FFT sizes are set up in prepare(), changing size only resets the buffers.
+*/
+class SpectralShaper
+{
+public:
+    enum {
+        minOrder = 9,
+        maxOrder = 11,
+        numSizes = maxOrder - minOrder + 1,
+        maxFftSize = 1 << maxOrder,
+        maxBins = maxFftSize / 2 + 1,
+    };
+
+    static int getFftSize (int sizeIndex) noexcept { return 1 << (minOrder + sizeIndex); }
+
+    //==============================================================================
+
+    void prepare (int channels)
+    {
+        numChannels = channels;
+
+        for (int i = 0; i < numSizes; ++i) {
+            const int size = getFftSize (i);
+            ffts[i].reset (new dsp::FFT (minOrder + i));
+            windows[i].malloc ((size_t)size);
+
+            //periodic Hann, so shifted copies add up exactly
+            for (int n = 0; n < size; ++n)
+                windows[i][n] = 0.5f - 0.5f * std::cos (MathConstants<float>::twoPi * (float)n / (float)size);
+        }
+
+        inputFifo.setSize (numChannels, maxFftSize);
+        outputFifo.setSize (numChannels, maxFftSize);
+        frame.malloc (2 * maxFftSize);
+        magnitudes.malloc (maxBins);
+        phases.malloc (maxBins);
+        scratch.setSize (2, maxBins);
+        states.calloc ((size_t)(numChannels * 2 * ShaperChain::maxStages));
+
+        setSize (sizeIndex, true);
+    }
+
+    void reset()
+    {
+        inputFifo.clear();
+        outputFifo.clear();
+        position = 0;
+        hopPosition = 0;
+        std::fill (states.get(), states.get() + numChannels * 2 * ShaperChain::maxStages, ShaperState());
+    }
+
+    void setSize (int newSizeIndex, bool force = false)
+    {
+        newSizeIndex = jlimit (0, (int)numSizes - 1, newSizeIndex);
+        if (newSizeIndex == sizeIndex && ! force)
+            return;
+
+        sizeIndex = newSizeIndex;
+        fftSize = getFftSize (sizeIndex);
+        hopSize = fftSize / 4;
+
+        //the overlapping squared windows sum to 3/8 fftSize / hopSize
+        float overlap = 0.0f;
+        for (int n = 0; n < fftSize; n += hopSize)
+            overlap += windows[sizeIndex][n] * windows[sizeIndex][n];
+        synthesisScale = 1.0f / overlap;
+        magnitudeScale = 4.0f / (float)fftSize;
+
+        reset();
+    }
+
+    //==============================================================================
+
+    void process (const ShaperChain& chain, bool shapePhases, float* const* channelData, int numSamples,
+                  const ShaperContext& context)
+    {
+        const int mask = fftSize - 1;
+
+        for (int start = 0; start < numSamples;) {
+            const int num = jmin (hopSize - hopPosition, numSamples - start);
+
+            for (int channel = 0; channel < numChannels; ++channel) {
+                float* data = channelData[channel] + start;
+                float* in = inputFifo.getWritePointer (channel);
+                float* out = outputFifo.getWritePointer (channel);
+
+                for (int i = 0; i < num; ++i) {
+                    const int index = (position + i) & mask;
+                    in[index] = data[i];
+                    data[i] = out[index];
+                    out[index] = 0.0f;
+                }
+            }
+
+            position = (position + num) & mask;
+            hopPosition += num;
+            start += num;
+
+            if (hopPosition == hopSize) {
+                hopPosition = 0;
+
+                for (int channel = 0; channel < numChannels; ++channel)
+                    processFrame (channel, chain, shapePhases, context);
+            }
+        }
+    }
+
+private:
+    //==============================================================================
+
+    void processFrame (int channel, const ShaperChain& chain, bool shapePhases, const ShaperContext& context)
+    {
+        const int mask = fftSize - 1;
+        const int numBins = fftSize / 2 + 1;
+        const float* window = windows[sizeIndex];
+        const float* in = inputFifo.getReadPointer (channel);
+
+        //position is the oldest input sample and the first output sample this frame adds to
+        for (int n = 0; n < fftSize; ++n)
+            frame[n] = in[(position + n) & mask] * window[n];
+
+        ffts[sizeIndex]->performRealOnlyForwardTransform (frame, true);
+
+        for (int k = 0; k < numBins; ++k) {
+            const float re = frame[2 * k];
+            const float im = frame[2 * k + 1];
+            magnitudes[k] = std::sqrt (re * re + im * im) * magnitudeScale;
+            phases[k] = shapePhases ? std::atan2 (im, re) / MathConstants<float>::pi : magnitudes[k];
+        }
+
+        ShaperState* channelStates = states + channel * 2 * ShaperChain::maxStages;
+        float* input = scratch.getWritePointer (0);
+        float* work = scratch.getWritePointer (1);
+
+        chain.process (magnitudes, numBins, channelStates, context, input, work, maxBins);
+
+        if (shapePhases) {
+            chain.process (phases, numBins, channelStates + ShaperChain::maxStages, context, input, work, maxBins);
+
+            for (int k = 0; k < numBins; ++k) {
+                const float magnitude = std::abs (magnitudes[k]) / magnitudeScale;
+                const float phase = phases[k] * MathConstants<float>::pi;
+                frame[2 * k] = magnitude * std::cos (phase);
+                frame[2 * k + 1] = magnitude * std::sin (phase);
+            }
+        }
+        else {
+            //phases holds the original magnitudes, so the bins only need rescaling
+            for (int k = 0; k < numBins; ++k) {
+                const float gain = std::abs (magnitudes[k]) / jmax (phases[k], 1.0e-20f);
+                frame[2 * k] *= gain;
+                frame[2 * k + 1] *= gain;
+            }
+        }
+
+        for (int k = 1; k < fftSize / 2; ++k) {
+            frame[2 * (fftSize - k)] = frame[2 * k];
+            frame[2 * (fftSize - k) + 1] = -frame[2 * k + 1];
+        }
+
+        ffts[sizeIndex]->performRealOnlyInverseTransform (frame);
+
+        float* out = outputFifo.getWritePointer (channel);
+        for (int n = 0; n < fftSize; ++n)
+            out[(position + n) & mask] += frame[n] * window[n] * synthesisScale;
+    }
+
+    //==============================================================================
+
+    int numChannels = 0;
+    int sizeIndex = 1;
+    int fftSize = 0;
+    int hopSize = 0;
+    float synthesisScale = 1.0f;
+    float magnitudeScale = 1.0f;
+
+    std::unique_ptr<dsp::FFT> ffts[numSizes];
+    HeapBlock<float> windows[numSizes];
+
+    AudioSampleBuffer inputFifo;
+    AudioSampleBuffer outputFifo;
+    int position = 0;
+    int hopPosition = 0;
+
+    HeapBlock<float> frame;
+    HeapBlock<float> magnitudes;
+    HeapBlock<float> phases;
+    AudioSampleBuffer scratch;
+    HeapBlock<ShaperState> states;  // numChannels * 2 * ShaperChain::maxStages, magnitudes then phases
+};
+
+//==============================================================================
@@ -0,0 +1,121 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** Jiles-Atherton magnetic hysteresis, the core of tape saturation.
+
+    Everything is normalised by the saturation magnetisation Ms, so the input is
+    the field h = H / Ms and the output the magnetisation m = M / Ms. The field is
+    assumed to move linearly between samples and dm/dt = dm/dh dh/dt is integrated
+    with a fixed step Runge-Kutta method of order 2 or 4.
+*/
+struct TapeHysteresisModel
+{
+    //Jiles-Atherton parameters divided by Ms = 350e3
+    const float a = 22.0e3f / 350.0e3f;     // anhysteretic shape
+    const float k = 27.0e3f / 350.0e3f;     // coercivity
+    const float alpha = 1.6e-3f;            // interdomain coupling
+    const float c = 0.17f;                  // reversibility
+
+    float sampleRate = 44100.0f;
+    float T = 1.0f / 44100.0f;
+
+    void prepare (double newSampleRate)
+    {
+        sampleRate = (float)newSampleRate;
+        T = 1.0f / sampleRate;
+    }
+
+    //==============================================================================
+
+    /** Langevin function L(x) = coth (x) - 1 / x and its derivative. The series is
+        used close to zero where the exact form cancels, and the fast Pade tanh
+        further out, where coth is flat beyond |x| = 5.
+    */
+    static forcedinline void langevin (float x, float& L, float& dL) noexcept
+    {
+        const float ax = std::abs (x);
+
+        if (ax < 1.0f) {
+            const float x2 = x * x;
+            L = x * (15.0f + x2) / (45.0f + 6.0f * x2);
+            dL = 1.0f / 3.0f - x2 * (1.0f / 15.0f) + x2 * x2 * (2.0f / 189.0f);
+            return;
+        }
+
+        const float coth = 1.0f / dsp::FastMathApproximations::tanh (jmin (ax, 5.0f));
+        const float invX = 1.0f / ax;
+        L = std::copysign (coth - invX, x);
+        dL = invX * invX - coth * coth + 1.0f;
+    }
+
+    /** dm/dt for the field h moving at hd. */
+    forcedinline float derivative (float m, float h, float hd) const noexcept
+    {
+        const float Q = (h + alpha * m) / a;
+        float L, dL;
+        langevin (Q, L, dL);
+
+        const float delta = hd >= 0.0f ? 1.0f : -1.0f;
+        const float difference = L - m;
+        const float deltaM = delta * difference > 0.0f ? 1.0f : 0.0f;
+
+        const float irreversible = (1.0f - c) * deltaM * difference
+                                   / ((1.0f - c) * delta * k - alpha * difference);
+        const float reversible = c / a * dL;
+        const float dmdh = (irreversible + reversible) / (1.0f - c * alpha / a * dL);
+
+        return dmdh * hd;
+    }
+
+    //==============================================================================
+
+    forcedinline float processRK2 (float h, float previousH, float m) const noexcept
+    {
+        const float hd = (h - previousH) * sampleRate;
+        const float k1 = T * derivative (m, previousH, hd);
+        const float k2 = T * derivative (m + k1, h, hd);
+        return limit (m + 0.5f * (k1 + k2));
+    }
+
+    forcedinline float processRK4 (float h, float previousH, float m) const noexcept
+    {
+        const float hd = (h - previousH) * sampleRate;
+        const float middle = 0.5f * (h + previousH);
+        const float k1 = T * derivative (m, previousH, hd);
+        const float k2 = T * derivative (m + 0.5f * k1, middle, hd);
+        const float k3 = T * derivative (m + 0.5f * k2, middle, hd);
+        const float k4 = T * derivative (m + k3, h, hd);
+        return limit (m + (k1 + 2.0f * k2 + 2.0f * k3 + k4) / 6.0f);
+    }
+
+    static forcedinline float limit (float m) noexcept
+    {
+        //a diverging step on extreme input must not poison the state
+        return std::isfinite (m) ? jlimit (-1.0f, 1.0f, m) : 0.0f;
+    }
+};
+
+//==============================================================================
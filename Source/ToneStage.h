@@ -0,0 +1,213 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "SoABiquad.h"
+
+//==============================================================================
+
+/** The linear filters around the shapers.
+
+    The pre pass is the emphasis shelf in front of the nonlinearity. The post pass
+    cascades the matching de-emphasis shelf, the tone shelf and a DC blocker,
+    which only runs behind shapers that make DC. When it comes back its state is
+    seeded as if its current input had always been there, so an offset that is
+    already present does not come through as a step. Each pass walks the block once with the channels as SoA lanes, so all the post filters share
+    one loop instead of one call per filter and channel.
+
+    A modulated tone is not redesigned per sample: the setup holds the tone shelf
+    at every dB of its range and the post pass interpolates between two entries
+    once per modulationInterval samples.
+*/
+class ToneStage
+{
+public:
+    enum {
+        numPostSections = 3,
+        toneTableMin = -48,             // dB, the tone range plus the largest modulation
+        toneTableMax = 36,
+        numToneSteps = toneTableMax - toneTableMin + 1,
+        modulationInterval = 32,
+    };
+
+    /** Everything that can change from the message thread, swapped as one object. */
+    struct Setup
+    {
+        SoABiquadCoefficients pre;
+        SoABiquadCoefficients post[numPostSections];    // de-emphasis, tone, DC blocker
+        BiquadCoefficients toneTable[numToneSteps];     // one tone shelf per dB
+        float toneDecibels = 0.0f;
+        int numChannels = 0;
+        bool emphasis = false;
+        bool dcBlocking = false;
+
+        void build (int channels, double sampleRate, double toneDiscreteFrequency, double toneGainDecibels,
+                    double emphasisFrequency, double emphasisDecibels, bool blockDc)
+        {
+            numChannels = channels;
+            emphasis = emphasisDecibels != 0.0;
+            dcBlocking = blockDc;
+            toneDecibels = (float)toneGainDecibels;
+
+            pre.allocate (channels);
+            for (int section = 0; section < numPostSections; ++section)
+                post[section].allocate (channels);
+
+            const BiquadCoefficients preEmphasis = BiquadCoefficients::makeHighShelf (sampleRate, emphasisFrequency, emphasisDecibels);
+            const BiquadCoefficients deEmphasis = BiquadCoefficients::makeHighShelf (sampleRate, emphasisFrequency, -emphasisDecibels);
+            const BiquadCoefficients dcBlocker = BiquadCoefficients::makeDcBlocker (sampleRate, 20.0);
+            const BiquadCoefficients tone = BiquadCoefficients::makeFirstOrderShelf (toneDiscreteFrequency, pow (10.0, toneGainDecibels * 0.05));
+
+            for (int step = 0; step < numToneSteps; ++step)
+                toneTable[step] = BiquadCoefficients::makeFirstOrderShelf (toneDiscreteFrequency, pow (10.0, (toneTableMin + step) * 0.05));
+
+            for (int channel = 0; channel < channels; ++channel) {
+                pre.set (channel, preEmphasis);
+                post[0].set (channel, emphasis ? deEmphasis : BiquadCoefficients());
+                post[1].set (channel, tone);
+                post[2].set (channel, dcBlocker);
+            }
+        }
+
+        /** The tone shelf at any gain in the table range, linear between the dB steps. */
+        BiquadCoefficients interpolateTone (float decibels) const noexcept
+        {
+            const float position = jlimit (0.0f, (float)(numToneSteps - 1), decibels - (float)toneTableMin);
+            const int index = jmin ((int)position, (int)numToneSteps - 2);
+            const float fraction = position - (float)index;
+            const BiquadCoefficients& a = toneTable[index];
+            const BiquadCoefficients& b = toneTable[index + 1];
+
+            BiquadCoefficients c;
+            c.b0 = a.b0 + fraction * (b.b0 - a.b0);
+            c.b1 = a.b1 + fraction * (b.b1 - a.b1);
+            c.b2 = a.b2 + fraction * (b.b2 - a.b2);
+            c.a1 = a.a1 + fraction * (b.a1 - a.a1);
+            c.a2 = a.a2 + fraction * (b.a2 - a.a2);
+            return c;
+        }
+    };
+
+    //==============================================================================
+
+    void prepare (int channels)
+    {
+        numChannels = channels;
+        preState.allocate (channels);
+        for (int section = 0; section < numPostSections; ++section)
+            postStates[section].allocate (channels);
+        modulatedTone.allocate (channels);
+        frame.calloc ((size_t)jmax (1, channels));
+    }
+
+    void reset() noexcept
+    {
+        preState.reset();
+        for (int section = 0; section < numPostSections; ++section)
+            postStates[section].reset();
+        dcBlockerWasOn = false;
+    }
+
+    //==============================================================================
+
+    void processPre (const Setup& setup, float* const* channelData, int numSamples) noexcept
+    {
+        const SoABiquadCoefficients* sections[] = { &setup.pre };
+
+        if (setup.emphasis && setup.numChannels == numChannels)
+            run (sections, &preState, 1, false, channelData, 0, numSamples);
+        else
+            preState.reset();  // so switching emphasis on starts from silence
+    }
+
+    /** toneOffsets, when given, holds a tone change in dB for every sample. */
+    void processPost (const Setup& setup, float* const* channelData, int numSamples,
+                      const float* toneOffsets = nullptr) noexcept
+    {
+        if (setup.numChannels != numChannels)
+            return;
+
+        //symmetric shapers leave the DC blocker out of the loop altogether
+        const int numSections = setup.dcBlocking ? numPostSections : numPostSections - 1;
+        bool seedDcBlocker = setup.dcBlocking && ! dcBlockerWasOn;
+        dcBlockerWasOn = setup.dcBlocking;
+
+        if (toneOffsets == nullptr) {
+            const SoABiquadCoefficients* sections[] = { &setup.post[0], &setup.post[1], &setup.post[2] };
+            run (sections, postStates, numSections, seedDcBlocker, channelData, 0, numSamples);
+            return;
+        }
+
+        const SoABiquadCoefficients* sections[] = { &setup.post[0], &modulatedTone, &setup.post[2] };
+        for (int start = 0; start < numSamples; start += modulationInterval) {
+            const BiquadCoefficients tone = setup.interpolateTone (setup.toneDecibels + toneOffsets[start]);
+            for (int channel = 0; channel < numChannels; ++channel)
+                modulatedTone.set (channel, tone);
+
+            run (sections, postStates, numSections, seedDcBlocker, channelData, start, jmin ((int)modulationInterval, numSamples - start));
+            seedDcBlocker = false;
+        }
+    }
+
+private:
+    //==============================================================================
+
+    /** seedLast sets the last section to its steady state for the first input it sees. */
+    void run (const SoABiquadCoefficients* const* sections, SoABiquadState* states, int numSections, bool seedLast,
+              float* const* channelData, int startSample, int numSamples) noexcept
+    {
+        for (int i = startSample; i < startSample + numSamples; ++i) {
+            for (int channel = 0; channel < numChannels; ++channel)
+                frame[channel] = channelData[channel][i];
+
+            for (int section = 0; section < numSections; ++section) {
+                if (seedLast && i == startSample && section == numSections - 1)
+                    seedSteadyState (*sections[section], states[section]);
+
+                processSoABiquad (*sections[section], states[section], frame, 0, numChannels);
+            }
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                channelData[channel][i] = frame[channel];
+        }
+    }
+
+    /** Only for the DC blocker: with b0 = -b1 and no b2, z1 = -b0 x makes a constant x come out as 0. */
+    void seedSteadyState (const SoABiquadCoefficients& c, SoABiquadState& s) noexcept
+    {
+        for (int channel = 0; channel < numChannels; ++channel) {
+            s.z1[channel] = -c.b0[channel] * frame[channel];
+            s.z2[channel] = 0.0f;
+        }
+    }
+
+    //==============================================================================
+
+    int numChannels = 0;
+    HeapBlock<float> frame;
+    bool dcBlockerWasOn = false;
+    SoABiquadState preState;
+    SoABiquadState postStates[numPostSections];
+    SoABiquadCoefficients modulatedTone;
+};
+
+//==============================================================================
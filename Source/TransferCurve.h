@@ -0,0 +1,213 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** A user drawn transfer curve, compiled into a cubic spline with uniform knots.
+
+    The control points are joined by a monotone cubic Hermite interpolant
+    (Fritsch-Carlson), so the curve never overshoots between them. That
+    interpolant is then resampled onto numSegments uniform segments, each one a
+    cubic in local time, which makes evaluation a clamp, a truncation and a
+    Horner step with no search and no branches.
+*/
+class TransferCurve
+{
+public:
+    enum {
+        numSegments = 256,
+    };
+
+    typedef Array<Point<float>> Points;
+
+    /** points span x = -1..1 sorted by x, the curve is held flat outside them. */
+    explicit TransferCurve (const Points& points)
+    {
+        jassert (points.size() >= 2);
+        const float segmentWidth = 2.0f / (float)numSegments;
+
+        Points knots;
+        Array<float> tangents;
+        makeMonotoneTangents (points, knots, tangents);
+
+        for (int segment = 0; segment < numSegments; ++segment) {
+            const float x0 = -1.0f + segmentWidth * (float)segment;
+            const float x1 = x0 + segmentWidth;
+
+            float p0, p1, m0, m1;
+            evaluate (knots, tangents, x0, false, p0, m0);
+            evaluate (knots, tangents, x1, true, p1, m1);
+            m0 *= segmentWidth;
+            m1 *= segmentWidth;
+
+            float* c = coefficients + 4 * segment;
+            c[0] = p0;
+            c[1] = m0;
+            c[2] = 3.0f * (p1 - p0) - 2.0f * m0 - m1;
+            c[3] = 2.0f * (p0 - p1) + m0 + m1;
+        }
+    }
+
+    //==============================================================================
+
+    forcedinline float processSample (float x) const noexcept
+    {
+        const float position = jlimit (0.0f, (float)numSegments, (x + 1.0f) * (0.5f * (float)numSegments));
+        const int segment = jmin ((int)position, (int)numSegments - 1);
+        const float t = position - (float)segment;
+
+        const float* c = coefficients + 4 * segment;
+        return c[0] + t * (c[1] + t * (c[2] + t * c[3]));
+    }
+
+    void process (float* data, int numSamples) const noexcept
+    {
+        for (int i = 0; i < numSamples; ++i)
+            data[i] = processSample (data[i]);
+    }
+
+    //==============================================================================
+
+    static Points getDefaultPoints()
+    {
+        Points points;
+        points.add ({ -1.0f, -1.0f });
+        points.add ({ 1.0f, 1.0f });
+        return points;
+    }
+
+    /** "x y x y ...", as kept in the plugin state. */
+    static String toString (const Points& points)
+    {
+        StringArray values;
+        for (const Point<float>& point : points) {
+            values.add (String (point.x));
+            values.add (String (point.y));
+        }
+        return values.joinIntoString (" ");
+    }
+
+    static Points fromString (const String& text)
+    {
+        StringArray values;
+        values.addTokens (text, " ", "");
+        values.removeEmptyStrings();
+
+        Points points;
+        for (int i = 0; i + 1 < values.size(); i += 2)
+            points.add ({ jlimit (-1.0f, 1.0f, values[i].getFloatValue()),
+                          jlimit (-1.0f, 1.0f, values[i + 1].getFloatValue()) });
+
+        if (points.size() < 2)
+            return getDefaultPoints();
+        return points;
+    }
+
+private:
+    //==============================================================================
+
+    static void makeMonotoneTangents (const Points& points, Points& knots, Array<float>& tangents)
+    {
+        //drop points that do not advance in x, the slopes would be undefined
+        for (const Point<float>& point : points)
+            if (knots.isEmpty() || point.x > knots.getLast().x + 1.0e-6f)
+                knots.add (point);
+
+        const int n = knots.size();
+        tangents.insertMultiple (0, 0.0f, n);
+        if (n < 2)
+            return;
+
+        Array<float> secants;
+        for (int i = 0; i < n - 1; ++i)
+            secants.add ((knots[i + 1].y - knots[i].y) / (knots[i + 1].x - knots[i].x));
+
+        tangents.set (0, secants[0]);
+        tangents.set (n - 1, secants[n - 2]);
+        for (int i = 1; i < n - 1; ++i)
+            tangents.set (i, secants[i - 1] * secants[i] <= 0.0f ? 0.0f : 0.5f * (secants[i - 1] + secants[i]));
+
+        for (int i = 0; i < n - 1; ++i) {
+            if (secants[i] == 0.0f) {
+                tangents.set (i, 0.0f);
+                tangents.set (i + 1, 0.0f);
+                continue;
+            }
+
+            const float alpha = tangents[i] / secants[i];
+            const float beta = tangents[i + 1] / secants[i];
+            const float length = alpha * alpha + beta * beta;
+
+            if (length > 9.0f) {
+                const float tau = 3.0f / std::sqrt (length);
+                tangents.set (i, tau * alpha * secants[i]);
+                tangents.set (i + 1, tau * beta * secants[i]);
+            }
+        }
+    }
+
+    /** Value and slope of the Hermite interpolant, from the left or right side of a knot. */
+    static void evaluate (const Points& knots, const Array<float>& tangents, float x, bool fromLeft,
+                          float& value, float& slope)
+    {
+        const int n = knots.size();
+
+        if (n == 1 || x < knots[0].x || (fromLeft && x == knots[0].x)) {
+            value = knots[0].y;
+            slope = 0.0f;
+            return;
+        }
+        if (x > knots[n - 1].x || (! fromLeft && x == knots[n - 1].x)) {
+            value = knots[n - 1].y;
+            slope = 0.0f;
+            return;
+        }
+
+        int i = 0;
+        while (i < n - 2 && (fromLeft ? x > knots[i + 1].x : x >= knots[i + 1].x))
+            ++i;
+
+        const float h = knots[i + 1].x - knots[i].x;
+        const float s = (x - knots[i].x) / h;
+        const float s2 = s * s;
+        const float s3 = s2 * s;
+        const float y0 = knots[i].y;
+        const float y1 = knots[i + 1].y;
+        const float m0 = tangents[i] * h;
+        const float m1 = tangents[i + 1] * h;
+
+        value = (2.0f * s3 - 3.0f * s2 + 1.0f) * y0 + (s3 - 2.0f * s2 + s) * m0
+              + (3.0f * s2 - 2.0f * s3) * y1 + (s3 - s2) * m1;
+        slope = ((6.0f * s2 - 6.0f * s) * y0 + (3.0f * s2 - 4.0f * s + 1.0f) * m0
+              + (6.0f * s - 6.0f * s2) * y1 + (3.0f * s2 - 2.0f * s) * m1) / h;
+    }
+
+    //==============================================================================
+
+    float coefficients[4 * numSegments];
+
+    JUCE_DECLARE_NON_COPYABLE (TransferCurve)
+};
+
+//==============================================================================
@@ -0,0 +1,208 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "TransferCurve.h"
+
+//==============================================================================
+
+/** Draws the custom transfer curve and lets the user edit its control points:
+    click to add a point, drag to move it, double click to remove it. The end
+    points can only move vertically.
+
+    While a point is dragged the curve is sent at most dragUpdateRate times a
+    second with finished false, the final one goes out on mouse up.
+*/
+class TransferCurveEditor : public Component
+                          , private Timer
+{
+public:
+    std::function<void (const TransferCurve::Points&, bool finished)> onChange;
+
+    void setPoints (const TransferCurve::Points& newPoints)
+    {
+        points = newPoints;
+        preview.reset (new TransferCurve (points));
+        repaint();
+    }
+
+    //==============================================================================
+
+    void paint (Graphics& g) override
+    {
+        const Rectangle<float> bounds = getLocalBounds().toFloat();
+        g.setColour (getLookAndFeel().findColour (ComboBox::backgroundColourId));
+        g.fillRect (bounds);
+
+        g.setColour (getLookAndFeel().findColour (ComboBox::outlineColourId));
+        g.drawRect (bounds);
+        g.drawHorizontalLine (getHeight() / 2, bounds.getX(), bounds.getRight());
+        g.drawVerticalLine (getWidth() / 2, bounds.getY(), bounds.getBottom());
+
+        if (preview == nullptr)
+            return;
+
+        Path curve;
+        for (int column = 0; column < getWidth(); ++column) {
+            const float x = toCurve ({ (float)column, 0.0f }).x;
+            const float y = toScreen ({ x, preview->processSample (x) }).y;
+            if (column == 0)
+                curve.startNewSubPath ((float)column, y);
+            else
+                curve.lineTo ((float)column, y);
+        }
+
+        g.setColour (getLookAndFeel().findColour (Slider::thumbColourId));
+        g.strokePath (curve, PathStrokeType (2.0f));
+
+        for (const Point<float>& point : points) {
+            const Point<float> position = toScreen (point);
+            g.fillEllipse (position.x - pointRadius, position.y - pointRadius, 2.0f * pointRadius, 2.0f * pointRadius);
+        }
+    }
+
+    //==============================================================================
+
+    void mouseDown (const MouseEvent& event) override
+    {
+        dragging = findPoint (event.position);
+        if (dragging >= 0)
+            return;
+
+        //insert a new point in x order and start dragging it
+        const Point<float> point = toCurve (event.position);
+        dragging = 1;
+        while (dragging < points.size() - 1 && points[dragging].x < point.x)
+            ++dragging;
+
+        points.insert (dragging, point);
+        movePoint (event.position);
+    }
+
+    void mouseDrag (const MouseEvent& event) override
+    {
+        if (dragging >= 0)
+            movePoint (event.position);
+    }
+
+    void mouseUp (const MouseEvent&) override
+    {
+        if (dragging >= 0)
+            sendChange (true);
+        dragging = -1;
+    }
+
+    void mouseDoubleClick (const MouseEvent& event) override
+    {
+        const int index = findPoint (event.position);
+        if (index > 0 && index < points.size() - 1) {
+            points.remove (index);
+            pointsChanged();
+            sendChange (true);
+        }
+        dragging = -1;
+    }
+
+private:
+    //==============================================================================
+
+    const float pointRadius = 4.0f;
+    const int dragUpdateRate = 30;  // Hz
+
+    Point<float> toScreen (Point<float> point) const
+    {
+        return { (point.x + 1.0f) * 0.5f * (float)getWidth(), (1.0f - point.y) * 0.5f * (float)getHeight() };
+    }
+
+    Point<float> toCurve (Point<float> position) const
+    {
+        return { jlimit (-1.0f, 1.0f, position.x / (float)jmax (1, getWidth()) * 2.0f - 1.0f),
+                 jlimit (-1.0f, 1.0f, 1.0f - position.y / (float)jmax (1, getHeight()) * 2.0f) };
+    }
+
+    int findPoint (Point<float> position) const
+    {
+        for (int i = 0; i < points.size(); ++i)
+            if (toScreen (points[i]).getDistanceFrom (position) <= 2.0f * pointRadius)
+                return i;
+        return -1;
+    }
+
+    void movePoint (Point<float> position)
+    {
+        Point<float> point = toCurve (position);
+        const float gap = 1.0e-3f;
+
+        //the ends stay at the edges, the others stay between their neighbours
+        if (dragging == 0)
+            point.x = -1.0f;
+        else if (dragging == points.size() - 1)
+            point.x = 1.0f;
+        else {
+            //neighbours closer than two gaps leave no room, the point sits half way between them
+            const float lo = points[dragging - 1].x + gap;
+            const float hi = points[dragging + 1].x - gap;
+            point.x = lo <= hi ? jlimit (lo, hi, point.x) : 0.5f * (points[dragging - 1].x + points[dragging + 1].x);
+        }
+
+        points.set (dragging, point);
+        pointsChanged();
+    }
+
+    /** Only the preview follows every mouse event, the processor gets the points from the timer. */
+    void pointsChanged()
+    {
+        preview.reset (new TransferCurve (points));
+        repaint();
+
+        changePending = true;
+        if (! isTimerRunning())
+            startTimerHz (dragUpdateRate);
+    }
+
+    void timerCallback() override
+    {
+        if (changePending)
+            sendChange (false);
+        else
+            stopTimer();
+    }
+
+    void sendChange (bool finished)
+    {
+        changePending = false;
+        if (finished)
+            stopTimer();
+
+        if (onChange)
+            onChange (points, finished);
+    }
+
+    //==============================================================================
+
+    TransferCurve::Points points;
+    std::unique_ptr<TransferCurve> preview;
+    int dragging = -1;
+    bool changePending = false;
+};
+
+//==============================================================================
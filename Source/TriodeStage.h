@@ -0,0 +1,156 @@
+/*
+ ==============================================================================
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+ ==============================================================================
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+
+/** A 12AX7 common-cathode stage between an input and an output coupling capacitor,
+    written as a nonlinear state-space model:
+
+        v  = Cv x + Dv u        grid voltage
+        p  = f (v)              plate swing, solved offline on the load line
+        y  = Co x + Eo p
+        x' = A x + B u + E p
+
+    The two capacitors are the states. f() is tabulated in prepare(), so each
+    sample costs a 2x2 matrix-vector update and one interpolated table read.
+*/
+struct TriodeModel
+{
+    enum {
+        numStates = 2,
+        tableSize = 2048,
+    };
+
+    float A[numStates][numStates] = {};
+    float B[numStates] = {};
+    float E[numStates] = {};
+    float Cv[numStates] = {};
+    float Dv = 0.0f;
+    float Co[numStates] = {};
+    float Eo = 0.0f;
+
+    dsp::LookupTableTransform<float> plate;
+
+    //==============================================================================
+
+    void prepare (double sampleRate)
+    {
+        const double Rg = 1.0e6;        // grid leak
+        const double Cin = 22.0e-9;     // input coupling
+        const double Rl = 1.0e6;        // next stage
+        const double Cout = 22.0e-9;    // output coupling
+        const double inputToGrid = 2.0; // volts on the grid for a full scale input
+
+        //first order highpasses from the bilinear transform, y = s + b0 u, s' = -a1 s + (b1 - a1 b0) u
+        double b0i, b1i, a1i, b0o, b1o, a1o;
+        makeHighPass (sampleRate, 1.0 / (MathConstants<double>::twoPi * Rg * Cin), b0i, b1i, a1i);
+        makeHighPass (sampleRate, 1.0 / (MathConstants<double>::twoPi * Rl * Cout), b0o, b1o, a1o);
+
+        A[0][0] = (float)-a1i;  A[0][1] = 0.0f;
+        A[1][0] = 0.0f;         A[1][1] = (float)-a1o;
+        B[0] = (float)((b1i - a1i * b0i) * inputToGrid);
+        B[1] = 0.0f;
+        E[0] = 0.0f;
+        E[1] = (float)(b1o - a1o * b0o);
+        Cv[0] = 1.0f;
+        Cv[1] = 0.0f;
+        Dv = (float)(b0i * inputToGrid);
+        Co[0] = 0.0f;
+        Co[1] = 1.0f;
+        Eo = (float)b0o;
+
+        //plate swing normalised to unity small signal gain, inverted back to the input polarity
+        const double quiescent = solvePlateVoltage (0.0);
+        const double delta = 1.0e-3;
+        const double slope = (solvePlateVoltage (-delta) - solvePlateVoltage (delta)) / (2.0 * delta) * inputToGrid;
+
+        plate.initialise ([quiescent, slope] (float grid)
+                          {
+                              return (float)((quiescent - solvePlateVoltage ((double)grid)) / slope);
+                          },
+                          -12.0f, 12.0f, tableSize);
+    }
+
+    //==============================================================================
+
+    forcedinline float processSample (float u, float* x) const noexcept
+    {
+        const float v = Cv[0] * x[0] + Cv[1] * x[1] + Dv * u;
+        const float p = plate.processSample (v);
+        const float y = Co[0] * x[0] + Co[1] * x[1] + Eo * p;
+
+        const float x0 = A[0][0] * x[0] + A[0][1] * x[1] + B[0] * u + E[0] * p;
+        const float x1 = A[1][0] * x[0] + A[1][1] * x[1] + B[1] * u + E[1] * p;
+        x[0] = x0;
+        x[1] = x1;
+
+        return y;
+    }
+
+    //==============================================================================
+
+    /** Koren's plate current model of a 12AX7. */
+    static double plateCurrent (double vgk, double vpk)
+    {
+        const double mu = 100.0;
+        const double ex = 1.4;
+        const double kg1 = 1060.0;
+        const double kp = 600.0;
+        const double kvb = 300.0;
+
+        const double e1 = vpk / kp * log1p (exp (kp * (1.0 / mu + vgk / sqrt (kvb + vpk * vpk))));
+        return e1 > 0.0 ? pow (e1, ex) / kg1 : 0.0;
+    }
+
+    /** Plate voltage on the load line Vp = B+ - Rp Ip, found by bisection. */
+    static double solvePlateVoltage (double grid)
+    {
+        const double supply = 250.0;
+        const double Rp = 100.0e3;
+        const double cathode = 1.5;   // fixed bias
+
+        double lo = 0.0;
+        double hi = supply;
+
+        for (int i = 0; i < 60; ++i) {
+            const double vp = 0.5 * (lo + hi);
+            if (vp + Rp * plateCurrent (grid - cathode, vp) > supply)
+                hi = vp;
+            else
+                lo = vp;
+        }
+
+        return 0.5 * (lo + hi);
+    }
+
+    static void makeHighPass (double sampleRate, double frequency, double& b0, double& b1, double& a1)
+    {
+        const double K = tan (MathConstants<double>::pi * frequency / sampleRate);
+        b0 = 1.0 / (1.0 + K);
+        b1 = -b0;
+        a1 = (K - 1.0) / (K + 1.0);
+    }
+};
+
+//==============================================================================